@@ -0,0 +1,270 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import random
+import subprocess
+import tempfile
+import argparse
+import itertools
+import logging
+import time
+import numpy as np
+import pandas as pd
+import matplotlib.pyplot as plt
+
+from custom_compiler import PASS_PATH, PASS_NAME
+
+PHASE_LIST = [
+    'fixStack',
+    'create_region',
+    'analyzeRegion',
+    'transitionAnalysis',
+    'createFunctionB',
+    'modifyFunctionA',
+    'rewriteRegionInputs',
+    'verification',
+]
+
+
+class StressGenerator:
+    """
+    Generate a synthetic function for the split pass
+
+    blocks - number of basic blocks to generate (approximately)
+    loop_depth - maximum depth of loop nests
+    phi_density - probability of a loop or switch merge carrying a PHI node
+    live_ins - number of i64 arguments, used all over the function so they cross the split
+    switch_fanout - number of cases of the generated switches (0 or 1 disables switches)
+    """
+
+    def __init__(self, blocks, loop_depth, phi_density, live_ins, switch_fanout, seed=0):
+        self.target = blocks
+        self.loop_depth = loop_depth
+        self.phi_density = phi_density
+        self.live_ins = live_ins
+        self.switch_fanout = switch_fanout
+        self.rand = random.Random(seed)
+        self.blocks = {}
+        self.order = []
+        self.counter = 0
+        self.args = [f'%a{i}' for i in range(max(live_ins, 1))]
+
+    def new_name(self, prefix):
+        self.counter += 1
+        return f'{prefix}{self.counter}'
+
+    def new_block(self, prefix):
+        label = self.new_name(prefix)
+        self.blocks[label] = []
+        self.order.append(label)
+        return label
+
+    def operand(self, avail):
+        # Prefer the arguments so that many values are live across the split
+        if self.rand.random() < 0.5:
+            return self.rand.choice(self.args)
+        return self.rand.choice(avail)
+
+    def emit_arith(self, block, avail):
+        value = '%' + self.new_name('v')
+        op = self.rand.choice(['add', 'sub', 'mul', 'xor', 'and', 'or'])
+        self.blocks[block].append(f'{value} = {op} i64 {self.operand(avail)}, {self.operand(avail)}')
+        avail.append(value)
+        return value
+
+    def gen_loop(self, cur, avail, budget, depth):
+        header = self.new_block('loop')
+        self.blocks[cur].append(f'br label %{header}')
+        iv = '%' + self.new_name('iv')
+        acc = '%' + self.new_name('acc') if self.rand.random() < self.phi_density else None
+        init = self.operand(avail)
+
+        body = self.new_block('body')
+        inner = avail + [iv] + ([acc] if acc else [])
+        latch = self.gen_seq(body, inner, budget - 2, depth + 1)
+        iv_next = '%' + self.new_name('ivn')
+        self.blocks[latch].append(f'{iv_next} = add i64 {iv}, 1')
+        phis = [f'{iv} = phi i64 [0, %{cur}], [{iv_next}, %{latch}]']
+        if acc:
+            acc_next = '%' + self.new_name('accn')
+            self.blocks[latch].append(f'{acc_next} = add i64 {acc}, {self.rand.choice(inner)}')
+            phis.append(f'{acc} = phi i64 [{init}, %{cur}], [{acc_next}, %{latch}]')
+        self.blocks[latch].append(f'br label %{header}')
+
+        exit_block = self.new_block('exit')
+        cond = '%' + self.new_name('c')
+        self.blocks[header] = phis + [
+            f'{cond} = icmp slt i64 {iv}, 8',
+            f'br i1 {cond}, label %{body}, label %{exit_block}',
+        ]
+        avail.append(iv)
+        if acc:
+            avail.append(acc)
+        return exit_block
+
+    def gen_switch(self, cur, avail):
+        sel = self.emit_arith(cur, avail)
+        idx = '%' + self.new_name('s')
+        self.blocks[cur].append(f'{idx} = urem i64 {sel}, {self.switch_fanout}')
+        merge = self.new_block('merge')
+        cases = []
+        for i in range(self.switch_fanout):
+            case = self.new_block('case')
+            value = self.emit_arith(case, list(avail))
+            self.blocks[case].append(f'br label %{merge}')
+            cases.append((case, value))
+        # Keep the merge block after its cases in the layout
+        self.order.remove(merge)
+        self.order.append(merge)
+        labels = ' '.join(f'i64 {i}, label %{case}' for i, (case, _) in enumerate(cases) if i > 0)
+        self.blocks[cur].append(f'switch i64 {idx}, label %{cases[0][0]} [ {labels} ]')
+        if self.rand.random() < self.phi_density:
+            phi = '%' + self.new_name('m')
+            incoming = ', '.join(f'[{value}, %{case}]' for case, value in cases)
+            self.blocks[merge].append(f'{phi} = phi i64 {incoming}')
+            avail.append(phi)
+        return merge
+
+    def gen_seq(self, cur, avail, budget, depth):
+        """Fill about budget blocks starting from the open block cur, return the last open block"""
+        start = len(self.order)
+        while len(self.order) - start < budget:
+            left = budget - (len(self.order) - start)
+            choice = self.rand.random()
+            if depth < self.loop_depth and left >= 4 and choice < 0.3:
+                cur = self.gen_loop(cur, avail, min(left, max(4, left // 2)), depth)
+            elif self.switch_fanout > 1 and left >= self.switch_fanout + 2 and choice < 0.6:
+                cur = self.gen_switch(cur, avail)
+            else:
+                for i in range(self.rand.randint(1, 3)):
+                    self.emit_arith(cur, avail)
+                nxt = self.new_block('bb')
+                self.blocks[cur].append(f'br label %{nxt}')
+                cur = nxt
+        return cur
+
+    def generate(self):
+        entry = self.new_block('entry')
+        avail = list(self.args)
+        last = self.gen_seq(entry, avail, self.target - 2, 0)
+        result = self.emit_arith(last, avail)
+        self.blocks[last].append(f'store i64 {result}, i64* %p')
+        self.blocks[last].append(f'ret i64 {result}')
+
+        params = ', '.join(f'i64 {arg}' for arg in self.args)
+        lines = [f'define i64 @stress({params}, i64* %p) {{']
+        for label in self.order:
+            lines.append(f'{label}:')
+            lines += ['  ' + inst for inst in self.blocks[label]]
+        lines.append('}')
+        return '\n'.join(lines) + '\n'
+
+
+def opt_command(pass_path):
+    """Legacy pass manager plugins need -enable-new-pm=0 since LLVM 13"""
+    cmd = ['opt', '-load', pass_path]
+    version = subprocess.run(['opt', '--version'], capture_output=True, text=True).stdout
+    match = re.search(r'LLVM version (\d+)', version)
+    if match and int(match.group(1)) >= 13:
+        cmd.append('-enable-new-pm=0')
+    return cmd + [f'-{PASS_NAME}', '-func-split-time-phases']
+
+
+def parse_timer_report(report):
+    """Return the wall time of each phase from the func_split timer group"""
+    phases = {}
+    for line in report.splitlines():
+        match = re.match(r'^\s*(?:[\d.]+ \(\s*[\d.]+%\)\s+)+(\S+)\s*$', line)
+        if match and match.group(1) in PHASE_LIST:
+            wall = re.findall(r'([\d.]+) \(\s*[\d.]+%\)', line)[-1]
+            phases[match.group(1)] = float(wall)
+    return phases
+
+
+def run_once(cmd, ir_path):
+    start = time.perf_counter()
+    result = subprocess.run(cmd + [ir_path, '-o', os.devnull], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        logging.error(result.stderr[-2000:])
+        raise RuntimeError(f'opt failed on {ir_path}')
+    phases = parse_timer_report(result.stderr)
+    phases['total'] = elapsed
+    return phases
+
+
+def int_list(value):
+    return [int(v) for v in value.split(',')]
+
+
+def float_list(value):
+    return [float(v) for v in value.split(',')]
+
+
+if __name__ == '__main__':
+    logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(levelname)s - %(message)s')
+
+    logging.info("Start")
+    start = time.time()
+
+    parser = argparse.ArgumentParser(description='Compile-time scaling benchmark of the func_split pass.')
+    parser.add_argument('-b', '--blocks', type=int_list, default=[128, 256, 512, 1024, 2048], help="Comma separated basic block counts")
+    parser.add_argument('-l', '--loop-depth', type=int_list, default=[2], help="Comma separated maximum loop nest depths")
+    parser.add_argument('--phi-density', type=float_list, default=[0.5], help="Comma separated PHI probabilities of loops and merges")
+    parser.add_argument('--live-ins', type=int_list, default=[16], help="Comma separated argument counts")
+    parser.add_argument('--switch-fanout', type=int_list, default=[4], help="Comma separated switch case counts")
+    parser.add_argument('-r', '--repeat', type=int, default=3, help="Runs per module, the fastest one is kept")
+    parser.add_argument('-s', '--seed', type=int, default=0, help="Seed of the generator")
+    parser.add_argument('--pass-path', type=str, default=PASS_PATH, help="Path of func_split_pass.so")
+    parser.add_argument('-o', '--output', type=str, default='output/compile_time_scaling', help="Prefix of the csv and svg outputs")
+    args = parser.parse_args()
+
+    cmd = opt_command(args.pass_path)
+    rows = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        configs = itertools.product(args.loop_depth, args.phi_density, args.live_ins, args.switch_fanout, args.blocks)
+        for loop_depth, phi_density, live_ins, switch_fanout, blocks in configs:
+            ir = StressGenerator(blocks, loop_depth, phi_density, live_ins, switch_fanout, args.seed).generate()
+            ir_path = os.path.join(tmpdir, f'stress_{blocks}.ll')
+            with open(ir_path, 'w') as f:
+                f.write(ir)
+
+            best = {}
+            for _ in range(args.repeat):
+                for phase, seconds in run_once(cmd, ir_path).items():
+                    best[phase] = min(best.get(phase, seconds), seconds)
+            logging.info(f'blocks={blocks} loop_depth={loop_depth} phi_density={phi_density} live_ins={live_ins} '
+                         f'switch_fanout={switch_fanout} total={best["total"]:.4f}s')
+            for phase, seconds in best.items():
+                rows += [[blocks, loop_depth, phi_density, live_ins, switch_fanout, phase, seconds]]
+
+    df = pd.DataFrame(rows, columns=["blocks", "loop_depth", "phi_density", "live_ins", "switch_fanout", "phase", "seconds"])
+    df.to_csv(f'{args.output}.csv', index=False)
+
+    # Fit time ~ blocks^k per phase, k well above 1 means superlinear behaviour
+    plt.figure(figsize=(12, 8))
+    for keys, group in df.groupby(["loop_depth", "phi_density", "live_ins", "switch_fanout", "phase"]):
+        group = group[group["seconds"] > 0].sort_values("blocks")
+        if len(group) < 2:
+            continue
+        k = np.polyfit(np.log(group["blocks"]), np.log(group["seconds"]), 1)[0]
+        message = f'{keys[-1]} (loop_depth={keys[0]}, phi_density={keys[1]}, live_ins={keys[2]}, switch_fanout={keys[3]}): time ~ blocks^{k:.2f}'
+        if k > 1.5:
+            logging.warning(message)
+        else:
+            logging.info(message)
+        plt.plot(group["blocks"], group["seconds"], marker="o", label=f'{keys[-1]} k={k:.2f}')
+
+    plt.xscale("log")
+    plt.yscale("log")
+    plt.xlabel("Basic blocks", fontsize=12)
+    plt.ylabel("Seconds", fontsize=12)
+    plt.title("func_split compile time scaling", fontsize=14, pad=20)
+    plt.legend(fontsize=8)
+    plt.grid(True, alpha=0.3)
+    plt.tight_layout()
+    plt.savefig(f'{args.output}.svg')
+
+    end = time.time()
+    logging.info(f"[*] Time Cost: {end - start} seconds")
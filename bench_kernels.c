@@ -0,0 +1,122 @@
+// Small kernels for bench_micro, compiled once per split strategy
+// VARIANT prefixes every symbol so that all variants can be linked into one binary
+#include <stddef.h>
+
+#ifndef VARIANT
+#define VARIANT base
+#endif
+#define KERNEL_CAT2(a, b) a##_##b
+#define KERNEL_CAT(a, b) KERNEL_CAT2(a, b)
+#define KERNEL(name) KERNEL_CAT(VARIANT, name)
+
+// Tight loop with a data dependent branch
+long KERNEL(loop_sum)(const long *data, long n) {
+    long sum = 0;
+    for (long i = 0; i < n; i++) {
+        if (data[i] & 1)
+            sum += data[i] * 3;
+        else
+            sum -= data[i] >> 1;
+    }
+    return sum;
+}
+
+// Recursive function, every call goes through the split
+long KERNEL(fib)(long n) {
+    if (n < 2)
+        return n;
+    long a = KERNEL(fib)(n - 1);
+    long b = KERNEL(fib)(n - 2);
+    return a + b;
+}
+
+// Switch heavy bytecode interpreter
+enum {
+    OP_PUSH,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DUP,
+    OP_SWAP,
+    OP_JNZ,
+    OP_HALT,
+};
+
+long KERNEL(interp)(const unsigned char *code, long len, long steps) {
+    long stack[64];
+    long sp = 0;
+    long pc = 0;
+    stack[sp++] = 1;
+    stack[sp++] = 1;
+    while (steps-- > 0) {
+        unsigned char op = code[pc % len];
+        pc++;
+        switch (op & 7) {
+        case OP_PUSH:
+            if (sp < 64)
+                stack[sp++] = code[pc % len];
+            pc++;
+            break;
+        case OP_ADD:
+            if (sp > 1) {
+                sp--;
+                stack[sp - 1] += stack[sp];
+            }
+            break;
+        case OP_SUB:
+            if (sp > 1) {
+                sp--;
+                stack[sp - 1] -= stack[sp];
+            }
+            break;
+        case OP_MUL:
+            if (sp > 1) {
+                sp--;
+                stack[sp - 1] *= stack[sp] | 1;
+            }
+            break;
+        case OP_DUP:
+            if (sp > 0 && sp < 64) {
+                stack[sp] = stack[sp - 1];
+                sp++;
+            }
+            break;
+        case OP_SWAP:
+            if (sp > 1) {
+                long t = stack[sp - 1];
+                stack[sp - 1] = stack[sp - 2];
+                stack[sp - 2] = t;
+            }
+            break;
+        case OP_JNZ:
+            if (sp > 0 && stack[sp - 1] & 1)
+                pc += code[pc % len] & 3;
+            break;
+        case OP_HALT:
+            sp = sp > 2 ? sp / 2 : sp;
+            break;
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : 0;
+}
+
+// String processing: count words and hash them
+long KERNEL(str_words)(const char *s, long len) {
+    long words = 0;
+    unsigned long hash = 5381;
+    int in_word = 0;
+    for (long i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == ' ' || c == '\n' || c == '\t') {
+            in_word = 0;
+        } else {
+            if (!in_word)
+                words++;
+            in_word = 1;
+            if (c >= 'A' && c <= 'Z')
+                c = c - 'A' + 'a';
+            hash = hash * 33 + (unsigned char)c;
+        }
+    }
+    return words ^ (long)(hash & 0xffff);
+}
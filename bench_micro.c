@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+#include <getopt.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Split strategies linked into this binary, each one has a <strategy>_count build
+// with -func-split-count-transitions next to it, see the bench_micro target of the Makefile
+#ifndef BENCH_VARIANTS
+#define BENCH_VARIANTS X(mean)
+#endif
+
+#define DATA_LEN (1 << 16)
+#define CODE_LEN 256
+#define INTERP_STEPS (1 << 18)
+#define TEXT_LEN (1 << 18)
+#define FIB_N 24
+
+// Incremented by the proxy blocks of the *_count builds
+long long func_split_transitions = 0;
+
+static long data[DATA_LEN];
+static unsigned char code[CODE_LEN];
+static char text[TEXT_LEN];
+
+#define DECLARE_KERNELS(v)                                       \
+    long v##_loop_sum(const long *data, long n);                 \
+    long v##_fib(long n);                                        \
+    long v##_interp(const unsigned char *code, long len, long steps); \
+    long v##_str_words(const char *s, long len);                 \
+    static long v##_run_loop_sum(void) { return v##_loop_sum(data, DATA_LEN); } \
+    static long v##_run_fib(void) { return v##_fib(FIB_N); }     \
+    static long v##_run_interp(void) { return v##_interp(code, CODE_LEN, INTERP_STEPS); } \
+    static long v##_run_str_words(void) { return v##_str_words(text, TEXT_LEN); }
+
+#define KERNEL_TABLE(v) {v##_run_loop_sum, v##_run_fib, v##_run_interp, v##_run_str_words}
+
+const char *kernel_list[] = {
+    "loop_sum",
+    "fib",
+    "interp",
+    "str_words",
+};
+#define KERNEL_COUNT (sizeof(kernel_list) / sizeof(kernel_list[0]))
+
+typedef long (*kernel_fn)(void);
+
+struct variant {
+    const char *name;
+    kernel_fn run[KERNEL_COUNT];
+    kernel_fn count[KERNEL_COUNT];
+};
+
+DECLARE_KERNELS(base)
+#define X(v) DECLARE_KERNELS(v) DECLARE_KERNELS(v##_count)
+BENCH_VARIANTS
+#undef X
+
+struct variant variant_list[] = {
+    {"base", KERNEL_TABLE(base), KERNEL_TABLE(base)},
+#define X(v) {#v, KERNEL_TABLE(v), KERNEL_TABLE(v##_count)},
+    BENCH_VARIANTS
+#undef X
+};
+const int variant_count = sizeof(variant_list) / sizeof(variant_list[0]);
+
+int debug = 0;
+
+void logging(const char *level, const char *format, va_list args) {
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    char time_buf[20];
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    fprintf(stderr, "%s - %s - ", time_buf, level);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+}
+
+void log_info(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("INFO", format, args);
+    va_end(args);
+}
+
+void log_debug(const char *format, ...) {
+    if (!debug) return;
+    va_list args;
+    va_start(args, format);
+    logging("DEBUG", format, args);
+    va_end(args);
+}
+
+// Cycle counter, serialized so the kernel does not leak out of the measured interval
+static inline uint64_t cycles_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Number of cycle counter ticks per nanosecond
+static double calibrate(void) {
+    struct timespec pause = {0, 100 * 1000 * 1000};
+    uint64_t ns0 = monotonic_ns();
+    uint64_t c0 = cycles_now();
+    nanosleep(&pause, NULL);
+    uint64_t c1 = cycles_now();
+    uint64_t ns1 = monotonic_ns();
+    return (double)(c1 - c0) / (double)(ns1 - ns0);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Median cycles of one call of fn
+static uint64_t measure(kernel_fn fn, int warmup, int repeat, uint64_t *samples) {
+    volatile long sink = 0;
+    for (int i = 0; i < warmup; i++)
+        sink += fn();
+    for (int i = 0; i < repeat; i++) {
+        uint64_t start = cycles_now();
+        sink += fn();
+        samples[i] = cycles_now() - start;
+    }
+    (void)sink;
+    qsort(samples, repeat, sizeof(samples[0]), compare_u64);
+    return samples[repeat / 2];
+}
+
+static void init_inputs(void) {
+    srand(12345);
+    for (int i = 0; i < DATA_LEN; i++)
+        data[i] = rand();
+    for (int i = 0; i < CODE_LEN; i++)
+        code[i] = rand() & 0xff;
+    for (int i = 0; i < TEXT_LEN; i++) {
+        int r = rand() % 8;
+        text[i] = r == 0 ? ' ' : r == 1 ? '\n' : (r & 1 ? 'A' : 'a') + rand() % 26;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int repeat = 101;
+    int warmup = 5;
+    int opt;
+    const char *output = "output/bench_micro_result.csv";
+
+    while ((opt = getopt(argc, argv, "r:w:o:d")) != -1) {
+        switch (opt) {
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'd':
+                debug = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r repeat] [-w warmup] [-o output.csv] [-d]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (repeat < 1)
+        repeat = 1;
+
+    log_info("Start");
+    init_inputs();
+    double ticks_per_ns = calibrate();
+    log_info("Cycle counter: %.3f ticks/ns", ticks_per_ns);
+
+    FILE *fp = fopen(output, "w");
+    if (!fp) {
+        perror("fopen failed");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(fp, "kernel,variant,ns_per_call,slowdown,transitions_per_call,ns_per_transition\n");
+
+    uint64_t *samples = malloc(sizeof(uint64_t) * repeat);
+    if (!samples) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-10s %-10s %14s %9s %14s %12s\n", "kernel", "variant", "ns/call", "slowdown", "transitions", "ns/trans");
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        double base_ns = 0;
+        for (int v = 0; v < variant_count; v++) {
+            struct variant *var = &variant_list[v];
+
+            // The results must not change with the split
+            if (var->run[k]() != variant_list[0].run[k]()) {
+                fprintf(stderr, "%s/%s: result differs from base\n", kernel_list[k], var->name);
+                exit(EXIT_FAILURE);
+            }
+
+            double ns = measure(var->run[k], warmup, repeat, samples) / ticks_per_ns;
+            log_debug("%s/%s: min %.0f ns max %.0f ns", kernel_list[k], var->name,
+                      samples[0] / ticks_per_ns, samples[repeat - 1] / ticks_per_ns);
+
+            long long transitions = 0;
+            if (v > 0) {
+                func_split_transitions = 0;
+                var->count[k]();
+                transitions = func_split_transitions;
+            } else {
+                base_ns = ns;
+            }
+
+            double slowdown = ns / base_ns;
+            double ns_per_transition = transitions > 0 ? (ns - base_ns) / transitions : 0;
+            printf("%-10s %-10s %14.1f %9.3f %14lld %12.3f\n", kernel_list[k], var->name, ns, slowdown, transitions, ns_per_transition);
+            fprintf(fp, "%s,%s,%.3f,%.6f,%lld,%.6f\n", kernel_list[k], var->name, ns, slowdown, transitions, ns_per_transition);
+        }
+    }
+
+    free(samples);
+    fclose(fp);
+    log_info("[*] Results written to %s", output);
+    return 0;
+}
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import subprocess
+import tempfile
+import argparse
+import logging
+import time
+import pandas as pd
+
+from custom_compiler import PASS_PATH, PASS_NAME
+from bench_compile_time import opt_command
+
+# Loops placed in the second half of their function, so the mean strategy moves them into the fragment
+PROLOGUE = '''entry:
+  %cmp0 = icmp sgt i64 %n, 0
+  br i1 %cmp0, label %check, label %done
+check:
+  %m = and i64 %mode, 1
+  %odd = icmp eq i64 %m, 1
+  br i1 %odd, label %first, label %pre
+first:
+  store {ty} 0{zero}, {ty}* %a
+  br label %pre
+pre:
+  br label %loop
+'''
+
+EPILOGUE = '''after:
+  br label %done
+done:
+  ret void
+}}
+'''
+
+KERNEL_LIST = {
+    # a[i] = b[i] + c[i]
+    'add': ('float', '.0', '''define void @add(float* %a, float* %b, float* %c, i64 %n, i64 %mode) {{
+{prologue}loop:
+  %i = phi i64 [0, %pre], [%inext, %loop]
+  %pb = getelementptr inbounds float, float* %b, i64 %i
+  %pc = getelementptr inbounds float, float* %c, i64 %i
+  %vb = load float, float* %pb
+  %vc = load float, float* %pc
+  %s = fadd float %vb, %vc
+  %pa = getelementptr inbounds float, float* %a, i64 %i
+  store float %s, float* %pa
+  %inext = add nuw nsw i64 %i, 1
+  %ex = icmp eq i64 %inext, %n
+  br i1 %ex, label %after, label %loop
+{epilogue}'''),
+    # a[0] = sum(b[i] * c[i])
+    'dot': ('i32', '', '''define void @dot(i32* %a, i32* %b, i32* %c, i64 %n, i64 %mode) {{
+{prologue}loop:
+  %i = phi i64 [0, %pre], [%inext, %loop]
+  %acc = phi i32 [0, %pre], [%accn, %loop]
+  %pb = getelementptr inbounds i32, i32* %b, i64 %i
+  %pc = getelementptr inbounds i32, i32* %c, i64 %i
+  %vb = load i32, i32* %pb
+  %vc = load i32, i32* %pc
+  %p = mul i32 %vb, %vc
+  %accn = add i32 %acc, %p
+  %inext = add nuw nsw i64 %i, 1
+  %ex = icmp eq i64 %inext, %n
+  br i1 %ex, label %store, label %loop
+store:
+  store i32 %accn, i32* %a
+  br label %after
+{epilogue}'''),
+}
+
+DRIVER = '''#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+void {name}({ty} *a, {ty} *b, {ty} *c, long n, long mode);
+int main(int argc, char *argv[]) {{
+    long n = atol(argv[1]), repeat = atol(argv[2]);
+    {ty} *a = calloc(n, sizeof({ty})), *b = malloc(n * sizeof({ty})), *c = malloc(n * sizeof({ty}));
+    for (long i = 0; i < n; i++) {{
+        b[i] = i % 7;
+        c[i] = i % 5;
+    }}
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    for (long r = 0; r < repeat; r++)
+        {name}(a, b, c, n, 0);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%.6f %.0f\\n", ns / repeat / n, (double)a[n / 2] + a[0]);
+    return 0;
+}}
+'''
+
+
+def host_triple():
+    version = subprocess.run(['llc', '--version'], capture_output=True, text=True).stdout
+    match = re.search(r'Default target:\s*(\S+)', version)
+    return match.group(1) if match else 'x86_64-unknown-linux-gnu'
+
+
+def kernel_ir(name):
+    ty, zero, body = KERNEL_LIST[name]
+    prologue = PROLOGUE.format(ty=ty, zero=zero)
+    return f'target triple = "{host_triple()}"\n\n' + body.format(prologue=prologue, epilogue=EPILOGUE.format())
+
+
+def run(cmd):
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        logging.error(result.stderr[-2000:])
+        raise RuntimeError(f'{cmd[0]} failed')
+    return result
+
+
+def vectorize_remarks(yaml_path):
+    """Map each function to the width of its vectorized loop, 0 when none was vectorized"""
+    widths = {}
+    with open(yaml_path) as f:
+        for doc in f.read().split('--- ')[1:]:
+            function = re.search(r'Function:\s*(\S+)', doc)
+            if not function:
+                continue
+            widths.setdefault(function.group(1), 0)
+            if doc.startswith('!Passed') and re.search(r'Name:\s*Vectorized', doc):
+                width = re.search(r"VectorizationFactor:\s*'?(\d+)", doc)
+                widths[function.group(1)] = int(width.group(1)) if width else 1
+    return widths
+
+
+if __name__ == '__main__':
+    logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(levelname)s - %(message)s')
+
+    logging.info("Start")
+    start = time.time()
+
+    parser = argparse.ArgumentParser(description='Check that loops moved into split functions are still vectorized.')
+    parser.add_argument('-n', '--elements', type=int, default=4096, help="Elements per kernel call")
+    parser.add_argument('-r', '--repeat', type=int, default=20000, help="Kernel calls per measurement")
+    parser.add_argument('--pass-path', type=str, default=PASS_PATH, help="Path of func_split_pass.so")
+    parser.add_argument('--cc', type=str, default=os.environ.get('CC', 'cc'), help="C compiler of the driver")
+    parser.add_argument('-o', '--output', type=str, default='output/bench_vectorize_result.csv', help="Output csv")
+    args = parser.parse_args()
+
+    # The split runs before the -O2 pipeline, whose inliner must keep the fragments out of line
+    split = opt_command(args.pass_path) + ['-func-split-placement=pre-opt']
+    variants = {
+        'base': None,
+        'split': split + ['-func-split-abi-attrs=true'],
+        'split_noattrs': split + ['-func-split-abi-attrs=false'],
+    }
+    rows = []
+    with tempfile.TemporaryDirectory() as tmpdir:
+        for kernel, (ty, _, _) in KERNEL_LIST.items():
+            src = os.path.join(tmpdir, f'{kernel}.ll')
+            with open(src, 'w') as f:
+                f.write(kernel_ir(kernel))
+            driver = os.path.join(tmpdir, f'{kernel}_main.c')
+            with open(driver, 'w') as f:
+                f.write(DRIVER.format(name=kernel, ty='float' if ty == 'float' else 'int'))
+
+            for variant, cmd in variants.items():
+                ir = src
+                if cmd:
+                    ir = os.path.join(tmpdir, f'{kernel}_{variant}.bc')
+                    run(cmd + [src, '-o', ir])
+                optimized = os.path.join(tmpdir, f'{kernel}_{variant}.opt.bc')
+                remarks = os.path.join(tmpdir, f'{kernel}_{variant}.yaml')
+                run(['opt', '-O2', f'-pass-remarks-output={remarks}', '-pass-remarks-filter=loop-vectorize', ir, '-o', optimized])
+                obj = os.path.join(tmpdir, f'{kernel}_{variant}.o')
+                run(['llc', '-O2', '-filetype=obj', '-relocation-model=pic', optimized, '-o', obj])
+                exe = os.path.join(tmpdir, f'{kernel}_{variant}')
+                run([args.cc, '-O2', driver, obj, '-o', exe])
+                ns, check = run([exe, str(args.elements), str(args.repeat)]).stdout.split()
+
+                widths = vectorize_remarks(remarks)
+                # The loop lives in the fragment after the split
+                function = kernel if variant == 'base' else f'{kernel}_splitFlag'
+                width = widths.get(function, 0)
+                logging.info(f'{kernel}/{variant}: vectorization width {width}, {float(ns):.4f} ns/element')
+                if width == 0 and widths.get(kernel, 0) > 0:
+                    logging.warning(f'{kernel}/{variant}: the loop is vectorized in the unsplit function only')
+                rows += [[kernel, variant, width, float(ns), check]]
+
+    df = pd.DataFrame(rows, columns=["kernel", "variant", "vector_width", "ns_per_element", "checksum"])
+    for kernel, group in df.groupby("kernel"):
+        if group["checksum"].nunique() != 1:
+            logging.error(f'{kernel}: results differ between variants')
+    df.to_csv(args.output, index=False)
+    print(df.to_string(index=False))
+
+    end = time.time()
+    logging.info(f"[*] Time Cost: {end - start} seconds")
@@ -5,6 +5,7 @@ from tqdm import tqdm
 import logging
 import argparse
 import time
+from vector_store import load_merged
 
 def compute_metrics(samples, ks=[1, 2, 5, 10]):
     """
@@ -88,7 +89,11 @@ if __name__ == '__main__':
     pool = args.pool
     logging.info(f'pool: {pool}')
 
-    datasets_df = pd.read_pickle(args.input)
+    # Output of `vector_store join`, or the pickle of merge_vector.py
+    if args.input.endswith('.vmg'):
+        datasets_df = load_merged(args.input)
+    else:
+        datasets_df = pd.read_pickle(args.input)
 
     type_list = {
         "O0-O0_split":  {"target":"O0", "match":["O0_split", "O0_splitFlag"]},
@@ -8,6 +8,9 @@ import subprocess
 PASS_PATH = "/home/test/my_lib/my_paper/func_split/demo/func_split_pass/func_split_pass.so"
 PASS_NAME = "func_split"
 CC = "clang"
+# Run the split inside clang's own pipeline instead of with opt afterwards:
+# pre-opt, post-inline or pre-codegen, see -func-split-placement of the pass
+PLACEMENT = os.environ.get("FUNC_SPLIT_PLACEMENT", "")
 
 def run_command(command: str):
     """Execute command and check return value"""
@@ -60,6 +63,11 @@ def main():
     if not output_file:
         output_file = os.path.splitext(input_file)[0] + ".o"
 
+    if PLACEMENT:
+        run_command(f"{CC} -c -fno-experimental-new-pass-manager -Xclang -load -Xclang {PASS_PATH} "
+                    f"-mllvm -func-split-placement={PLACEMENT} {' '.join(other_args)} {input_file} -o {output_file}")
+        return
+
     # Generate temporary files
     temp_bc = os.path.splitext(input_file)[0] + ".bc"
     temp_opt_bc = os.path.splitext(input_file)[0] + ".optimized.bc"
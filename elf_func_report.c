@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Per-function .text size of the split builds, each parent function together with its
+// <name>_splitFlag fragment, compared to the same function of the baseline build
+#define FRAGMENT_SUFFIX "_splitFlag"
+#define DATASET_DIR "./datasets/coreutils-8.30"
+
+struct func {
+    const char *name;
+    uint64_t addr;
+    uint64_t size;
+};
+
+struct symbols {
+    void *map;
+    size_t map_size;
+    struct func *funcs;
+    int count;
+    uint64_t text_size;
+};
+
+int debug = 0;
+
+void logging(const char *level, const char *format, va_list args) {
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    char time_buf[20];
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    fprintf(stderr, "%s - %s - ", time_buf, level);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+}
+
+void log_info(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("INFO", format, args);
+    va_end(args);
+}
+
+void log_debug(const char *format, ...) {
+    if (!debug) return;
+    va_list args;
+    va_start(args, format);
+    logging("DEBUG", format, args);
+    va_end(args);
+}
+
+static int compare_name(const void *a, const void *b) {
+    return strcmp(((const struct func *)a)->name, ((const struct func *)b)->name);
+}
+
+// Symbols of the functions in executable sections, sorted by name
+// Returns 0 when the file is not a 64-bit ELF or has no symbol table
+int load_symbols(const char *path, struct symbols *syms) {
+    memset(syms, 0, sizeof(*syms));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        log_info("%s: %s", path, strerror(errno));
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        log_info("%s: not an ELF file", path);
+        return 0;
+    }
+    syms->map_size = st.st_size;
+    syms->map = mmap(NULL, syms->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (syms->map == MAP_FAILED) {
+        perror("mmap failed");
+        exit(EXIT_FAILURE);
+    }
+
+    const unsigned char *base = syms->map;
+    const Elf64_Ehdr *ehdr = syms->map;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_shoff == 0 || ehdr->e_shoff + (uint64_t)ehdr->e_shnum * sizeof(Elf64_Shdr) > syms->map_size) {
+        log_info("%s: not a 64-bit ELF file", path);
+        return 0;
+    }
+    const Elf64_Shdr *shdr = (const Elf64_Shdr *)(base + ehdr->e_shoff);
+
+    // Prefer the full symbol table, stripped binaries only have the dynamic one
+    const Elf64_Shdr *symtab = NULL;
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if (shdr[i].sh_type == SHT_SYMTAB)
+            symtab = &shdr[i];
+        else if (shdr[i].sh_type == SHT_DYNSYM && !symtab)
+            symtab = &shdr[i];
+    }
+    for (int i = 0; i < ehdr->e_shnum; i++) {
+        if ((shdr[i].sh_flags & SHF_EXECINSTR) && shdr[i].sh_type == SHT_PROGBITS)
+            syms->text_size += shdr[i].sh_size;
+    }
+    if (!symtab || symtab->sh_link >= ehdr->e_shnum) {
+        log_info("%s: no symbol table", path);
+        return 0;
+    }
+    const Elf64_Shdr *strhdr = &shdr[symtab->sh_link];
+    if (symtab->sh_offset > syms->map_size || symtab->sh_size > syms->map_size - symtab->sh_offset ||
+        strhdr->sh_offset > syms->map_size || strhdr->sh_size > syms->map_size - strhdr->sh_offset) {
+        log_info("%s: symbol table out of the file", path);
+        return 0;
+    }
+
+    const Elf64_Sym *sym = (const Elf64_Sym *)(base + symtab->sh_offset);
+    const char *strtab = (const char *)(base + strhdr->sh_offset);
+    size_t sym_count = symtab->sh_size / sizeof(Elf64_Sym);
+    syms->funcs = malloc(sizeof(struct func) * sym_count);
+    if (!syms->funcs) {
+        perror("malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < sym_count; i++) {
+        if (ELF64_ST_TYPE(sym[i].st_info) != STT_FUNC || sym[i].st_size == 0 ||
+            sym[i].st_shndx == SHN_UNDEF || sym[i].st_shndx >= ehdr->e_shnum ||
+            !(shdr[sym[i].st_shndx].sh_flags & SHF_EXECINSTR))
+            continue;
+        // The name must end inside the string table
+        if (sym[i].st_name >= strhdr->sh_size ||
+            !memchr(strtab + sym[i].st_name, '\0', strhdr->sh_size - sym[i].st_name)) {
+            log_debug("%s: symbol %zu has a bad name offset", path, i);
+            continue;
+        }
+        struct func *f = &syms->funcs[syms->count++];
+        f->name = strtab + sym[i].st_name;
+        f->addr = sym[i].st_value;
+        f->size = sym[i].st_size;
+    }
+    qsort(syms->funcs, syms->count, sizeof(struct func), compare_name);
+    return 1;
+}
+
+void free_symbols(struct symbols *syms) {
+    free(syms->funcs);
+    if (syms->map && syms->map != MAP_FAILED)
+        munmap(syms->map, syms->map_size);
+    memset(syms, 0, sizeof(*syms));
+}
+
+const struct func *find_func(const struct symbols *syms, const char *name) {
+    struct func key = {name, 0, 0};
+    return bsearch(&key, syms->funcs, syms->count, sizeof(struct func), compare_name);
+}
+
+static int is_fragment(const char *name) {
+    size_t len = strlen(name), suffix = strlen(FRAGMENT_SUFFIX);
+    return len > suffix && strcmp(name + len - suffix, FRAGMENT_SUFFIX) == 0;
+}
+
+// Write one row per function of the split build, return the number of split functions
+int report_program(FILE *fp, FILE *summary_fp, const char *program, const char *type, const char *baseline) {
+    char path[1024];
+    struct symbols split, base;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", DATASET_DIR, type, program);
+    if (!load_symbols(path, &split)) {
+        free_symbols(&split);
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/%s/%s", DATASET_DIR, baseline, program);
+    if (!load_symbols(path, &base))
+        log_debug("%s: no baseline symbols", program);
+
+    int split_count = 0;
+    uint64_t split_size = 0, split_base_size = 0, distance_sum = 0;
+    for (int i = 0; i < split.count; i++) {
+        const struct func *f = &split.funcs[i];
+        // Static functions may share a name, only the first one is reported
+        if (is_fragment(f->name) || (i > 0 && strcmp(f->name, split.funcs[i - 1].name) == 0))
+            continue;
+
+        char fragment_name[1024];
+        snprintf(fragment_name, sizeof(fragment_name), "%s" FRAGMENT_SUFFIX, f->name);
+        const struct func *fragment = find_func(&split, fragment_name);
+        const struct func *orig = base.count ? find_func(&base, f->name) : NULL;
+
+        uint64_t size = f->size + (fragment ? fragment->size : 0);
+        fprintf(fp, "%s,%s,%s,%#llx,%llu", program, type, f->name, (unsigned long long)f->addr, (unsigned long long)f->size);
+        if (fragment) {
+            int64_t distance = (int64_t)(fragment->addr - f->addr);
+            fprintf(fp, ",%#llx,%llu,%lld", (unsigned long long)fragment->addr, (unsigned long long)fragment->size, (long long)distance);
+            split_count++;
+            split_size += size;
+            distance_sum += distance < 0 ? -distance : distance;
+            if (orig)
+                split_base_size += orig->size;
+        } else {
+            fprintf(fp, ",,,");
+        }
+        fprintf(fp, ",%llu", (unsigned long long)size);
+        if (orig)
+            fprintf(fp, ",%llu,%.6f\n", (unsigned long long)orig->size, (double)size / orig->size);
+        else
+            fprintf(fp, ",,\n");
+    }
+
+    fprintf(summary_fp, "%s,%s,%llu,%llu,%d,%llu,%llu,%.0f\n", program, type,
+            (unsigned long long)split.text_size, (unsigned long long)base.text_size, split_count,
+            (unsigned long long)split_size, (unsigned long long)split_base_size,
+            split_count ? (double)distance_sum / split_count : 0.0);
+    log_debug("%s/%s: %d split functions", type, program, split_count);
+
+    free_symbols(&split);
+    free_symbols(&base);
+    return split_count;
+}
+
+static int compare_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Every regular file of the type's directory, sorted
+char **list_programs(const char *type, int *count) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", DATASET_DIR, type);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror("opendir failed");
+        exit(EXIT_FAILURE);
+    }
+    int cap = 128;
+    char **programs = malloc(sizeof(char *) * cap);
+    *count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (*count == cap) {
+            cap *= 2;
+            programs = realloc(programs, sizeof(char *) * cap);
+        }
+        programs[(*count)++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    qsort(programs, *count, sizeof(char *), compare_str);
+    return programs;
+}
+
+FILE *open_csv(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("fopen failed");
+        exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+int main(int argc, char *argv[]) {
+    const char *type = "clang_O0_split_mean";
+    const char *baseline = "clang_O0";
+    const char *output = "output/elf_func_report";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:b:o:d")) != -1) {
+        switch (opt) {
+            case 't':
+                type = optarg;
+                break;
+            case 'b':
+                baseline = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'd':
+                debug = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t type] [-b baseline] [-o output_prefix] [-d] [program...]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    log_info("Start");
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.csv", output);
+    FILE *fp = open_csv(path);
+    fprintf(fp, "program,type,function,address,size,fragment_address,fragment_size,distance,total_size,baseline_size,growth\n");
+    snprintf(path, sizeof(path), "%s_summary.csv", output);
+    FILE *summary_fp = open_csv(path);
+    fprintf(summary_fp, "program,type,text_size,baseline_text_size,split_functions,split_size,split_baseline_size,mean_distance\n");
+
+    int count;
+    char **programs;
+    if (optind < argc) {
+        programs = &argv[optind];
+        count = argc - optind;
+    } else {
+        programs = list_programs(type, &count);
+    }
+
+    int split_count = 0;
+    for (int i = 0; i < count; i++)
+        split_count += report_program(fp, summary_fp, programs[i], type, baseline);
+
+    fclose(fp);
+    fclose(summary_fp);
+    log_info("[*] %d programs, %d split functions written to %s.csv", count, split_count, output);
+    return 0;
+}
@@ -0,0 +1,426 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+#include "vector_store.h"
+
+// MRR and Recall@k of the merged dataset written by `vector_store join`, the same pairs and
+// sampling as calculate_mrr_recall.py: every row is a target, its matches are the correct
+// entries and the rest of the pool is drawn from the target column of the other rows
+#define MAX_MATCH 2
+
+struct pair_def {
+    const char *name;
+    const char *target;
+    const char *match[MAX_MATCH];
+};
+
+const struct pair_def pair_list[] = {
+    {"O0-O0_split", "O0", {"O0_split", "O0_splitFlag"}},
+    {"O1-O1_split", "O1", {"O1_split", "O1_splitFlag"}},
+    {"O2-O2_split", "O2", {"O2_split", "O2_splitFlag"}},
+    {"O3-O3_split", "O3", {"O3_split", "O3_splitFlag"}},
+    {"O0-O3", "O0", {"O3", NULL}},
+    {"O0-O3_split", "O0", {"O3_split", "O3_splitFlag"}},
+};
+#define PAIR_COUNT (sizeof(pair_list) / sizeof(pair_list[0]))
+
+const int k_list[] = {1, 2, 5, 10};
+#define K_COUNT (sizeof(k_list) / sizeof(k_list[0]))
+
+// Rows handed to a thread at a time
+#define CHUNK 64
+
+struct dataset {
+    uint32_t dim;
+    uint32_t stride; // floats per row, rounded up for aligned SIMD loads
+    uint64_t rows;
+    uint32_t column_count;
+    const char **column_names;
+    float **columns; // normalized
+};
+
+struct job {
+    const struct dataset *data;
+    const float *target;
+    const float *match[MAX_MATCH];
+    int match_count;
+    int pool;
+    uint64_t seed;
+    uint64_t next; // next row, shared
+};
+
+struct thread_result {
+    double mrr;
+    double recall[K_COUNT];
+};
+
+struct worker {
+    pthread_t thread;
+    struct job *job;
+    struct thread_result result;
+};
+
+int debug = 0;
+
+void logging(const char *level, const char *format, va_list args) {
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    char time_buf[20];
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    fprintf(stderr, "%s - %s - ", time_buf, level);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+}
+
+void log_info(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("INFO", format, args);
+    va_end(args);
+}
+
+void log_debug(const char *format, ...) {
+    if (!debug) return;
+    va_list args;
+    va_start(args, format);
+    logging("DEBUG", format, args);
+    va_end(args);
+}
+
+void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("ERROR", format, args);
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// xorshift64*
+static inline uint64_t rng_next(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+// Uniform in [0, n)
+static inline uint64_t rng_below(uint64_t *state, uint64_t n) {
+    return (uint64_t)(((unsigned __int128)rng_next(state) * n) >> 64);
+}
+
+// Dot products of q with four rows at once, q is loaded once for all of them
+static void dot4(const float *q, const float *a, const float *b, const float *c, const float *d,
+                 uint32_t stride, float *out) {
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 sa = _mm256_setzero_ps(), sb = _mm256_setzero_ps();
+    __m256 sc = _mm256_setzero_ps(), sd = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < stride; i += 8) {
+        __m256 x = _mm256_load_ps(q + i);
+        sa = _mm256_fmadd_ps(x, _mm256_load_ps(a + i), sa);
+        sb = _mm256_fmadd_ps(x, _mm256_load_ps(b + i), sb);
+        sc = _mm256_fmadd_ps(x, _mm256_load_ps(c + i), sc);
+        sd = _mm256_fmadd_ps(x, _mm256_load_ps(d + i), sd);
+    }
+    // Horizontal sums of the four accumulators
+    __m256 ab = _mm256_hadd_ps(sa, sb);
+    __m256 cd = _mm256_hadd_ps(sc, sd);
+    __m256 abcd = _mm256_hadd_ps(ab, cd);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(abcd), _mm256_extractf128_ps(abcd, 1));
+    _mm_storeu_ps(out, sum);
+#else
+    float sa = 0, sb = 0, sc = 0, sd = 0;
+    for (uint32_t i = 0; i < stride; i++) {
+        sa += q[i] * a[i];
+        sb += q[i] * b[i];
+        sc += q[i] * c[i];
+        sd += q[i] * d[i];
+    }
+    out[0] = sa;
+    out[1] = sb;
+    out[2] = sc;
+    out[3] = sd;
+#endif
+}
+
+static float dot(const float *q, const float *a, uint32_t stride) {
+    float out[4];
+    dot4(q, a, a, a, a, stride, out);
+    return out[0];
+}
+
+// Cosine similarities of q with the rows of column at indices
+static void pool_similarities(const float *q, const float *column, uint32_t stride,
+                              const uint64_t *indices, int count, float *sims) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        dot4(q, column + indices[i] * stride, column + indices[i + 1] * stride,
+             column + indices[i + 2] * stride, column + indices[i + 3] * stride, stride, sims + i);
+    for (; i < count; i++)
+        sims[i] = dot(q, column + indices[i] * stride, stride);
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    const struct job *job = w->job;
+    const struct dataset *data = job->data;
+    uint64_t n = data->rows;
+    int negatives = job->pool - job->match_count;
+
+    uint64_t *indices = malloc(sizeof(uint64_t) * (negatives > 0 ? negatives : 1));
+    float *sims = malloc(sizeof(float) * (negatives > 0 ? negatives : 1));
+    uint32_t *stamp = calloc(n, sizeof(uint32_t)); // rows drawn for the current sample
+    if (!indices || !sims || !stamp)
+        fail("malloc failed");
+    uint32_t generation = 0;
+
+    memset(&w->result, 0, sizeof(w->result));
+    uint64_t start;
+    while ((start = __atomic_fetch_add(&((struct job *)job)->next, CHUNK, __ATOMIC_RELAXED)) < n) {
+        uint64_t end = start + CHUNK < n ? start + CHUNK : n;
+        for (uint64_t row = start; row < end; row++) {
+            // The pool of a row depends only on the seed and the row, not on the thread
+            uint64_t rng = splitmix64(job->seed ^ splitmix64(row)) | 1;
+
+            // Floyd's sampling of distinct rows out of the n - 1 others
+            if (++generation == 0) {
+                memset(stamp, 0, sizeof(uint32_t) * n);
+                generation = 1;
+            }
+            stamp[row] = generation;
+            for (uint64_t j = n - 1 - negatives; j < n - 1; j++) {
+                uint64_t t = rng_below(&rng, j + 1);
+                t += t >= row;
+                uint64_t last = j >= row ? j + 1 : j;
+                uint64_t pick = stamp[t] == generation ? last : t;
+                stamp[pick] = generation;
+                indices[j - (n - 1 - negatives)] = pick;
+            }
+
+            const float *q = job->target + row * data->stride;
+            pool_similarities(q, job->target, data->stride, indices, negatives, sims);
+            float correct[MAX_MATCH];
+            for (int m = 0; m < job->match_count; m++)
+                correct[m] = dot(q, job->match[m] + row * data->stride, data->stride);
+
+            // The rank of a correct entry is one plus the entries scoring higher, a linear pass
+            // instead of sorting the pool
+            int rank[MAX_MATCH];
+            int best = job->pool + 1;
+            for (int m = 0; m < job->match_count; m++) {
+                rank[m] = 1;
+                for (int o = 0; o < job->match_count; o++)
+                    rank[m] += o != m && correct[o] > correct[m];
+                for (int i = 0; i < negatives; i++)
+                    rank[m] += sims[i] > correct[m];
+                if (rank[m] < best)
+                    best = rank[m];
+            }
+            w->result.mrr += 1.0 / best;
+            for (size_t k = 0; k < K_COUNT; k++) {
+                int hits = 0;
+                for (int m = 0; m < job->match_count; m++)
+                    hits += rank[m] <= k_list[k];
+                w->result.recall[k] += (double)hits / job->match_count;
+            }
+        }
+    }
+
+    free(indices);
+    free(sims);
+    free(stamp);
+    return NULL;
+}
+
+// Copy every column into aligned rows of unit length
+void load_dataset(const char *path, struct dataset *data) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+        fail("%s: %m", path);
+    const unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fail("mmap %s: %m", path);
+
+    const struct merged_header *header = (const struct merged_header *)map;
+    if ((size_t)st.st_size < sizeof(*header) || memcmp(header->magic, MERGED_MAGIC, 8) != 0 ||
+        header->file_size != (uint64_t)st.st_size)
+        fail("%s: not a merged vector file", path);
+
+    data->dim = header->dim;
+    data->stride = ALIGN_UP(header->dim, 8);
+    data->rows = header->row_count;
+    data->column_count = header->column_count;
+    data->column_names = malloc(sizeof(char *) * data->column_count);
+    data->columns = malloc(sizeof(float *) * data->column_count);
+    const uint32_t *columns = (const uint32_t *)(map + header->columns_offset);
+    const char *strings = (const char *)(map + header->strings_offset);
+
+    for (uint32_t c = 0; c < data->column_count; c++) {
+        data->column_names[c] = strdup(strings + columns[c]);
+        const float *src = (const float *)(map + header->vectors_offset) + c * data->rows * data->dim;
+        float *dst = aligned_alloc(64, ALIGN_UP(sizeof(float) * data->rows * data->stride, 64));
+        if (!dst)
+            fail("malloc failed");
+        for (uint64_t r = 0; r < data->rows; r++) {
+            const float *v = src + r * data->dim;
+            float *out = dst + r * data->stride;
+            double norm = 0;
+            for (uint32_t i = 0; i < data->dim; i++)
+                norm += (double)v[i] * v[i];
+            float scale = norm > 0 ? 1.0 / sqrt(norm) : 0;
+            for (uint32_t i = 0; i < data->dim; i++)
+                out[i] = v[i] * scale;
+            for (uint32_t i = data->dim; i < data->stride; i++)
+                out[i] = 0;
+        }
+        data->columns[c] = dst;
+    }
+    munmap((void *)map, st.st_size);
+}
+
+const float *find_column(const struct dataset *data, const char *name) {
+    for (uint32_t c = 0; c < data->column_count; c++) {
+        if (strcmp(data->column_names[c], name) == 0)
+            return data->columns[c];
+    }
+    fail("no column %s", name);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int pool = 32;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = 0;
+    const char *output = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:j:S:o:d")) != -1) {
+        switch (opt) {
+            case 'p':
+                pool = atoi(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'S':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'd':
+                debug = 1;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if (argc - optind != 1)
+        goto usage;
+    if (threads < 1)
+        threads = 1;
+
+    log_info("Start");
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    log_info("pool: %d", pool);
+
+    struct dataset data;
+    load_dataset(argv[optind], &data);
+    log_info("%llu functions of dim %u, %d threads", (unsigned long long)data.rows, data.dim, threads);
+    if (data.rows == 0)
+        fail("no functions");
+
+    FILE *fp = NULL;
+    if (output) {
+        fp = fopen(output, "w");
+        if (!fp) {
+            perror("fopen failed");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(fp, "pair,pool,samples,mrr");
+        for (size_t k = 0; k < K_COUNT; k++)
+            fprintf(fp, ",recall_%d", k_list[k]);
+        fprintf(fp, "\n");
+    }
+
+    struct worker *workers = malloc(sizeof(struct worker) * threads);
+    double mrr_sum = 0, r1_sum = 0;
+    for (size_t p = 0; p < PAIR_COUNT; p++) {
+        const struct pair_def *pair = &pair_list[p];
+        struct job job = {0};
+        job.data = &data;
+        job.target = find_column(&data, pair->target);
+        for (int m = 0; m < MAX_MATCH && pair->match[m]; m++)
+            job.match[job.match_count++] = find_column(&data, pair->match[m]);
+        job.pool = pool;
+        job.seed = splitmix64(seed + p);
+        if (pool < job.match_count || (uint64_t)(pool - job.match_count) > data.rows - 1)
+            fail("pool %d does not fit %s", pool, pair->name);
+
+        for (int t = 0; t < threads; t++) {
+            workers[t].job = &job;
+            if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0)
+                fail("pthread_create failed");
+        }
+        struct thread_result total = {0};
+        for (int t = 0; t < threads; t++) {
+            pthread_join(workers[t].thread, NULL);
+            total.mrr += workers[t].result.mrr;
+            for (size_t k = 0; k < K_COUNT; k++)
+                total.recall[k] += workers[t].result.recall[k];
+        }
+
+        double mrr = total.mrr / data.rows;
+        log_info("%s avg_mrr: %.6f, avg_recalls: {1: %.6f, 2: %.6f, 5: %.6f, 10: %.6f}", pair->name, mrr,
+                 total.recall[0] / data.rows, total.recall[1] / data.rows,
+                 total.recall[2] / data.rows, total.recall[3] / data.rows);
+        mrr_sum += mrr;
+        r1_sum += total.recall[0] / data.rows;
+        if (fp) {
+            fprintf(fp, "%s,%d,%llu,%.6f", pair->name, pool, (unsigned long long)data.rows, mrr);
+            for (size_t k = 0; k < K_COUNT; k++)
+                fprintf(fp, ",%.6f", total.recall[k] / data.rows);
+            fprintf(fp, "\n");
+        }
+    }
+    if (fp)
+        fclose(fp);
+    free(workers);
+
+    gettimeofday(&end, NULL);
+    double total_time = (end.tv_sec - start.tv_sec) +
+                      (end.tv_usec - start.tv_usec) / 1000000.0;
+    log_info("MRR_avg: %.6f, R1_avg: %.6f", mrr_sum / PAIR_COUNT, r1_sum / PAIR_COUNT);
+    log_info("[*] Time Cost: %.6f seconds", total_time);
+    return 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-p pool] [-j threads] [-S seed] [-o output.csv] [-d] merged.vmg\n", argv[0]);
+    exit(EXIT_FAILURE);
+}
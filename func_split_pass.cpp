@@ -5,15 +5,37 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/GlobPattern.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Utils.h"
 #include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
+#include <tuple>
 using namespace llvm;
 
 // origion_func
@@ -54,6 +76,12 @@ struct RegionAnalysisResult
 
     std::map<BasicBlock *, std::vector<BasicBlock *>> entries_orig_pred; // Predecessors of entry blocks
     std::map<BasicBlock *, std::vector<BasicBlock *>> exits_orig_succ;   // Successors of exit blocks
+    std::map<BasicBlock *, std::vector<int>> entry_in_idx;               // Indices of in_values used on paths from each entry
+    std::vector<bool> in_invariant;                                      // Inputs unchanged between transitions, stored once after their definition
+    std::vector<uint64_t> entry_freq;                                    // Estimated frequency of entering the region through each entry
+    std::vector<uint64_t> exit_freq;                                     // Estimated frequency of leaving the region through each exit
+
+    std::vector<std::vector<std::pair<BasicBlock *, Value *>>> in_loads; // Load blocks and loaded values of each input in function b
 };
 
 // Define the strategy of region split
@@ -61,25 +89,110 @@ enum Stratery
 {
     MEAN,    // Default value is 0
     DOMTREE, // Default value is 1
-    LOOP     // Default value is 2
+    LOOP,    // Default value is 2
+    MIN_TRANSFER // Default value is 3
+};
+
+// Time each phase of the split, the report is printed when opt exits
+static cl::opt<bool> TimePhases(
+    "func-split-time-phases",
+    cl::desc("Time each phase of func_split and print a report at exit"),
+    cl::init(false));
+static const char *PhaseGroup = "func_split";
+static const char *PhaseGroupDesc = "func_split phases";
+
+// Select the strategy of region split
+static cl::opt<Stratery> SplitStrategy(
+    "func-split-strategy",
+    cl::desc("The strategy of region split"),
+    cl::values(
+        clEnumValN(MEAN, "mean", "Move the second half of the basic blocks"),
+        clEnumValN(DOMTREE, "domtree", "Split by the dominator tree"),
+        clEnumValN(LOOP, "loop", "Split by loops"),
+        clEnumValN(MIN_TRANSFER, "min-transfer", "Move the contiguous blocks passing the least data to function b")),
+    cl::init(MEAN));
+
+// Size range of the min-transfer regions: fraction +/- balance of the basic blocks
+static cl::opt<double> SplitBalance(
+    "func-split-balance",
+    cl::desc("Largest deviation of the min-transfer region from the split fraction, as a share of the basic blocks"),
+    cl::init(0.2));
+
+// Count the transitions into split functions, used by the microbenchmarks
+static cl::opt<bool> CountTransitions(
+    "func-split-count-transitions",
+    cl::desc("Increment the i64 global func_split_transitions on every call of a split function"),
+    cl::init(false));
+
+// Where the split runs when the plugin is loaded into a standard pipeline (clang -Xclang -load)
+enum Placement
+{
+    PLACE_NONE,        // Only when requested with -func_split
+    PLACE_PRE_OPT,     // Before the module optimizations, the fragments are kept out of the inliner with noinline
+    PLACE_POST_INLINE, // After the inliner and the function simplification passes
+    PLACE_PRE_CODEGEN  // At the end of the pipeline, right before code generation
 };
 
+static cl::opt<Placement> SplitPlacement(
+    "func-split-placement",
+    cl::desc("Where func_split runs in the standard optimization pipeline"),
+    cl::values(
+        clEnumValN(PLACE_NONE, "none", "Do not add func_split to the pipeline"),
+        clEnumValN(PLACE_PRE_OPT, "pre-opt", "Before the module optimizations"),
+        clEnumValN(PLACE_POST_INLINE, "post-inline", "After inlining, before vectorization"),
+        clEnumValN(PLACE_PRE_CODEGEN, "pre-codegen", "At the end of the optimization pipeline")),
+    cl::init(PLACE_NONE));
+
+// Describe the struct parameter and the forwarded pointers to the optimizers of the fragment
+static cl::opt<bool> AbiAttributes(
+    "func-split-abi-attrs",
+    cl::desc("Add aliasing, nonnull, dereferenceable and alignment information to the split function ABI"),
+    cl::init(true));
+
+// Limit the stack growth of a split: the frame of function a plus the frame of function b below it,
+// against the frame of the function before fixStack
+static cl::opt<unsigned> FrameBudget(
+    "func-split-frame-budget",
+    cl::desc("Largest growth in bytes of the combined stack frame of a split function, 0 for no limit"),
+    cl::init(0));
+
+// Return address and saved frame pointer of the call to function b
+static const uint64_t CallFrameOverhead = 16;
+
 // Define a set of basic blocks (multiple basic blocks to be migrated)
 using BasicBlockSet = std::set<BasicBlock *>;
 
 BasicBlockSet region_global;
 
-RegionAnalysisResult analyzeRegion(const BasicBlockSet region)
+// Sort the migrated blocks according to their order in the original function
+std::vector<BasicBlock *> getOrderedBlocks(Function *func_o, const BasicBlockSet region)
+{
+    std::vector<BasicBlock *> ordered;
+    for (BasicBlock &BB : *func_o)
+    { // Assuming funcA is the original function
+        if (region.count(&BB))
+        {
+            ordered.push_back(&BB);
+        }
+    }
+    return ordered;
+}
+
+// verbose prints every block, instruction and operand visited to stdout
+// The blocks are visited in function order, so the struct layout does not depend on their addresses
+RegionAnalysisResult analyzeRegion(const BasicBlockSet region, bool verbose)
 {
     RegionAnalysisResult result;
+    std::vector<BasicBlock *> ordered_region = getOrderedBlocks((*region.begin())->getParent(), region);
     std::set<Value *> defined_in_region;
     std::set<Value *> var_already_in;
     std::vector<BasicBlock *> temp_orig_pred_succ;
 
     // Collect entry blocks (locations in function A that jump to the region)
-    for (BasicBlock *BB : region)
+    for (BasicBlock *BB : ordered_region)
     {
-        BB->print(outs());
+        if (verbose)
+            BB->print(outs());
         temp_orig_pred_succ.clear();
         for (auto pred : predecessors(BB))
         {
@@ -98,17 +211,22 @@ RegionAnalysisResult analyzeRegion(const BasicBlockSet region)
     }
 
     // Collect input variables (external dependencies)
-    for (BasicBlock *BB : region)
+    for (BasicBlock *BB : ordered_region)
     {
-        BB->print(outs());
+        if (verbose)
+            BB->print(outs());
         for (Instruction &I : *BB)
         {
-            I.print(outs());
+            if (verbose)
+                I.print(outs());
             for (Use &U : I.operands())
             {
                 Value *V = U.get();
-                V->print(outs());
-                outs() << "\n";
+                if (verbose)
+                {
+                    V->print(outs());
+                    outs() << "\n";
+                }
                 // if (isa<Constant>(V) || isa<Argument>(V))
                 if (isa<Constant>(V) || isa<BasicBlock>(V) || isa<GlobalValue>(V))
                     continue;
@@ -123,8 +241,11 @@ RegionAnalysisResult analyzeRegion(const BasicBlockSet region)
                 {
                     result.in_values.push_back(V);
                     var_already_in.insert(V);
-                    V->print(outs());
-                    outs() << "\n";
+                    if (verbose)
+                    {
+                        V->print(outs());
+                        outs() << "\n";
+                    }
                 }
             }
             // Collect defined variables
@@ -132,13 +253,14 @@ RegionAnalysisResult analyzeRegion(const BasicBlockSet region)
             {
                 defined_in_region.insert(&I);
                 // result.out_values.push_back(&I);
-                I.print(outs());
+                if (verbose)
+                    I.print(outs());
             }
         }
     }
 
     // Analyze exit blocks (blocks that jump to function A)
-    for (BasicBlock *BB : region)
+    for (BasicBlock *BB : ordered_region)
     {
         temp_orig_pred_succ.clear();
         Instruction *term = BB->getTerminator();
@@ -159,9 +281,132 @@ RegionAnalysisResult analyzeRegion(const BasicBlockSet region)
         result.exits_orig_succ[BB] = temp_orig_pred_succ;
     }
 
+    // Collect the input variables reachable from each entry, so every entry path only passes what it uses
+    std::map<Value *, int> in_idx;
+    for (unsigned i = 0; i < result.in_values.size(); i++)
+    {
+        in_idx[result.in_values[i]] = i;
+    }
+    for (BasicBlock *entryBB : result.entries)
+    {
+        std::set<BasicBlock *> visited;
+        std::set<int> used;
+        std::vector<BasicBlock *> worklist = {entryBB};
+        while (!worklist.empty())
+        {
+            BasicBlock *BB = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(BB).second)
+                continue;
+            for (Instruction &I : *BB)
+            {
+                for (Use &U : I.operands())
+                {
+                    auto it = in_idx.find(U.get());
+                    if (it != in_idx.end())
+                        used.insert(it->second);
+                }
+            }
+            for (BasicBlock *succ : successors(BB))
+            {
+                if (region.count(succ))
+                    worklist.push_back(succ);
+            }
+        }
+        result.entry_in_idx[entryBB] = std::vector<int>(used.begin(), used.end());
+    }
+
     return result;
 }
 
+// Mark the input variables that do not change between repeated transitions into the region
+// An input defined outside every loop containing an entry edge that uses it (e.g. an argument or an
+// alloca created by fixStack in the entry block) only needs to be stored once, right after its definition
+void markInvariantInputs(LoopInfo &LI, RegionAnalysisResult &result)
+{
+    std::vector<unsigned> def_depth(result.in_values.size(), 0);
+    result.in_invariant.assign(result.in_values.size(), true);
+    for (unsigned i = 0; i < result.in_values.size(); i++)
+    {
+        if (Instruction *I = dyn_cast<Instruction>(result.in_values[i]))
+        {
+            def_depth[i] = LI.getLoopDepth(I->getParent());
+            // The value of a terminator is only available in its successors
+            if (I->isTerminator())
+                result.in_invariant[i] = false;
+        }
+    }
+    for (BasicBlock *entryBB : result.entries)
+    {
+        for (BasicBlock *pred : result.entries_orig_pred[entryBB])
+        {
+            unsigned pred_depth = LI.getLoopDepth(pred);
+            for (int i : result.entry_in_idx[entryBB])
+            {
+                if (def_depth[i] >= pred_depth)
+                    result.in_invariant[i] = false;
+            }
+        }
+    }
+}
+
+// Estimate how often each entry and exit edge of the region is taken
+// Uses the static branch heuristics, or the profile metadata when the module carries one
+void estimateTransitionFrequency(const BasicBlockSet region, BlockFrequencyInfo &BFI, BranchProbabilityInfo &BPI, RegionAnalysisResult &result)
+{
+    result.entry_freq.assign(result.entries.size(), 0);
+    result.exit_freq.assign(result.exits.size(), 0);
+    for (BasicBlock *entryBB : result.entries)
+    {
+        std::set<BasicBlock *> preds(result.entries_orig_pred[entryBB].begin(), result.entries_orig_pred[entryBB].end());
+        for (BasicBlock *pred : preds)
+        {
+            uint64_t freq = BPI.getEdgeProbability(pred, entryBB).scale(BFI.getBlockFreq(pred).getFrequency());
+            result.entry_freq[result.entry_id_map[entryBB]] += freq;
+        }
+    }
+    for (BasicBlock *BB : region)
+    {
+        std::set<BasicBlock *> succs(result.exits_orig_succ[BB].begin(), result.exits_orig_succ[BB].end());
+        for (BasicBlock *succ : succs)
+        {
+            uint64_t freq = BPI.getEdgeProbability(BB, succ).scale(BFI.getBlockFreq(BB).getFrequency());
+            result.exit_freq[result.exit_map[succ]] += freq;
+        }
+    }
+}
+
+// Jump to targets[id], testing the targets in decreasing order of frequency
+// The hottest target becomes the switch default (or a plain branch when there is only one target),
+// and the branch weights let the backend lay out the common transition as fall-through
+Instruction *createDispatch(IRBuilder<> &Builder, Value *id, const std::vector<BasicBlock *> &targets, const std::vector<uint64_t> &freq)
+{
+    if (targets.size() == 1)
+    {
+        return Builder.CreateBr(targets[0]);
+    }
+
+    std::vector<unsigned> order(targets.size());
+    for (unsigned i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&freq](unsigned a, unsigned b)
+                     { return freq[a] > freq[b]; });
+
+    // Branch weights are 32-bit, scale the frequencies down to fit
+    uint64_t scale = freq[order[0]] / UINT32_MAX + 1;
+    std::vector<uint32_t> weights;
+    weights.push_back(freq[order[0]] / scale);
+
+    SwitchInst *dispatch = Builder.CreateSwitch(id, targets[order[0]], targets.size() - 1);
+    for (unsigned i = 1; i < order.size(); i++)
+    {
+        dispatch->addCase(ConstantInt::get(Type::getInt32Ty(Builder.getContext()), order[i]), targets[order[i]]);
+        weights.push_back(freq[order[i]] / scale);
+    }
+    dispatch->setMetadata(LLVMContext::MD_prof, MDBuilder(Builder.getContext()).createBranchWeights(weights));
+    return dispatch;
+}
+
 std::map<BasicBlock *, BlockData> bb_info;
 int analyzeBlock(BasicBlock *b_t)
 {
@@ -228,18 +473,59 @@ StructType *createStructType(LLVMContext &Context, const BlockData &data)
     return StructType::create(Context, types, "block_data_t");
 }
 
-// Sort the migrated blocks according to their order in the original function
-std::vector<BasicBlock *> getOrderedBlocks(Function *func_o, const BasicBlockSet region)
+// Keep what is known about a pointer forwarded through the struct on its load in function b:
+// arguments pass on their attributes, allocas are nonnull, dereferenceable and aligned
+void annotateForwardedPointer(LoadInst *LI, Value *V, const DataLayout &DL)
 {
-    std::vector<BasicBlock *> ordered;
-    for (BasicBlock &BB : *func_o)
-    { // Assuming funcA is the original function
-        if (region.count(&BB))
+    if (!V->getType()->isPointerTy())
+    {
+        return;
+    }
+    LLVMContext &Context = LI->getContext();
+    MDBuilder MDB(Context);
+    auto bytes = [&](uint64_t N)
+    {
+        return MDNode::get(Context, MDB.createConstant(ConstantInt::get(Type::getInt64Ty(Context), N)));
+    };
+
+    bool nonnull = false;
+    uint64_t deref = 0, deref_or_null = 0, align = 0;
+    if (Argument *A = dyn_cast<Argument>(V))
+    {
+        nonnull = A->hasNonNullAttr();
+        deref = A->getDereferenceableBytes();
+        deref_or_null = A->getDereferenceableOrNullBytes();
+        if (MaybeAlign MA = A->getParamAlign())
         {
-            ordered.push_back(&BB);
+            align = MA->value();
         }
     }
-    return ordered;
+    else if (AllocaInst *AI = dyn_cast<AllocaInst>(V))
+    {
+        nonnull = !NullPointerIsDefined(AI->getFunction(), AI->getType()->getPointerAddressSpace());
+        if (!AI->isArrayAllocation())
+        {
+            deref = DL.getTypeAllocSize(AI->getAllocatedType());
+        }
+        align = AI->getAlign().value();
+    }
+
+    if (nonnull)
+    {
+        LI->setMetadata(LLVMContext::MD_nonnull, MDNode::get(Context, {}));
+    }
+    if (deref)
+    {
+        LI->setMetadata(LLVMContext::MD_dereferenceable, bytes(deref));
+    }
+    else if (deref_or_null)
+    {
+        LI->setMetadata(LLVMContext::MD_dereferenceable_or_null, bytes(deref_or_null));
+    }
+    if (align > 1)
+    {
+        LI->setMetadata(LLVMContext::MD_align, bytes(align));
+    }
 }
 
 // Create new function b and migrate basic blocks
@@ -297,6 +583,35 @@ Function *createFunctionB(Function *func_o, const BasicBlockSet region, StructTy
     }
 
     Function *funcB = Function::Create(funcTy, Function::InternalLinkage, func_b_name, M);
+    // A single call site of an internal function is the first thing the inliner folds back, which
+    // only runs after the split with the pre-opt placement; optnone requires noinline anyway
+    if (SplitPlacement == PLACE_PRE_OPT || func_o->hasOptNone())
+    {
+        funcB->addFnAttr(Attribute::NoInline);
+    }
+    if (func_o->hasOptNone())
+    {
+        funcB->addFnAttr(Attribute::OptimizeNone);
+    }
+
+    // The struct is a stack slot of the caller used only for this call, and the fragment only reads it
+    const DataLayout &DL = M->getDataLayout();
+    if (structTy_ptr && AbiAttributes)
+    {
+        Argument *structArg = funcB->getArg(0);
+        structArg->addAttr(Attribute::NoAlias);
+        structArg->addAttr(Attribute::NoCapture);
+        if (result.out_values.empty())
+        {
+            structArg->addAttr(Attribute::ReadOnly);
+        }
+        if (!NullPointerIsDefined(func_o))
+        {
+            structArg->addAttr(Attribute::NonNull);
+        }
+        structArg->addAttr(Attribute::getWithDereferenceableBytes(Context, DL.getTypeAllocSize(structTy_ptr)));
+        structArg->addAttr(Attribute::getWithAlignment(Context, DL.getPrefTypeAlign(structTy_ptr)));
+    }
 
     // Create entry and exit blocks
     BasicBlock *entry = BasicBlock::Create(Context, "entry", funcB);
@@ -310,55 +625,42 @@ Function *createFunctionB(Function *func_o, const BasicBlockSet region, StructTy
     Value *flagPtr = Builder.CreateAlloca(Int32Ty, nullptr, "flag_out");
 
     // Create the entry switch function
-    std::map<Value *, Value *> oldToNew;
-    if (structTy_ptr)
+    // Each entry gets its own load block that only loads the input variables used on paths from that entry
+    result.in_loads.assign(result.in_values.size(), {});
+    Value *structPtr = structTy_ptr ? &*(funcB->arg_begin()) : nullptr;
+    std::map<BasicBlock *, BasicBlock *> entry_load_bb;
+    for (BasicBlock *entryBB : result.entries)
     {
-        // Load input variables from the struct
-        Value *structPtr = &*(funcB->arg_begin());
-        for (unsigned i = 0; i < result.in_values.size(); i++)
-        {
-            Value *GEP = Builder.CreateStructGEP(structTy_ptr, structPtr, i);
-            result.in_values[i]->print(outs());
-            outs() << "\n";
-            Value *loaded = Builder.CreateLoad(result.in_values[i]->getType(), GEP);
-            oldToNew[result.in_values[i]] = loaded;
-        }
-        if (flag_in)
+        BasicBlock *load_bb = flag_in ? BasicBlock::Create(Context, "load_" + entryBB->getName(), funcB) : entry;
+        entry_load_bb[entryBB] = load_bb;
+        IRBuilder<> loadBuilder(load_bb);
+        if (structPtr)
         {
-            Value *entry_id = funcB->arg_begin() + 1; // The second parameter is entry_id
-
-            // Create a case for each entry point
-            SwitchInst *entrySwitch = Builder.CreateSwitch(entry_id, result.entries[0], result.entries.size());
-            for (int i = 0; i < result.entries.size(); i++)
+            // Load input variables from the struct
+            for (int i : result.entry_in_idx[entryBB])
             {
-                BasicBlock *target = result.entries[i];
-                entrySwitch->addCase(ConstantInt::get(Type::getInt32Ty(Context), i), target);
+                Value *GEP = loadBuilder.CreateStructGEP(structTy_ptr, structPtr, i);
+                result.in_values[i]->print(outs());
+                outs() << "\n";
+                LoadInst *loaded = loadBuilder.CreateLoad(result.in_values[i]->getType(), GEP);
+                if (AbiAttributes)
+                {
+                    annotateForwardedPointer(loaded, result.in_values[i], DL);
+                }
+                result.in_loads[i].push_back({load_bb, loaded});
             }
         }
-        else
-        {
-            Builder.CreateBr(result.entries[0]);
-        }
+        loadBuilder.CreateBr(entryBB);
     }
-    else
+    if (flag_in)
     {
+        Value *entry_id = structPtr ? funcB->arg_begin() + 1 : funcB->arg_begin(); // The last parameter is entry_id
 
-        if (flag_in)
-        {
-            Value *entry_id = funcB->arg_begin(); // The second parameter is entry_id
-
-            // Create a case for each entry point
-            SwitchInst *entrySwitch = Builder.CreateSwitch(entry_id, result.entries[0], result.entries.size());
-            for (int i = 0; i < result.entries.size(); i++)
-            {
-                BasicBlock *target = result.entries[i];
-                entrySwitch->addCase(ConstantInt::get(Type::getInt32Ty(Context), i), target);
-            }
-        }
-        else
-        {
-            Builder.CreateBr(result.entries[0]);
-        }
+        // Dispatch to the load block of each entry point, hottest first
+        std::vector<BasicBlock *> targets;
+        for (BasicBlock *entryBB : result.entries)
+            targets.push_back(entry_load_bb[entryBB]);
+        createDispatch(Builder, entry_id, targets, result.entry_freq);
     }
 
     // Insert migrated blocks in the order of the original function
@@ -367,21 +669,6 @@ Function *createFunctionB(Function *func_o, const BasicBlockSet region, StructTy
     {
         BB->removeFromParent();
         BB->insertInto(funcB);
-        if (!oldToNew.empty())
-        {
-            for (Instruction &I : *BB)
-            {
-                outs() << I << "\n";
-                for (unsigned i = 0; i < I.getNumOperands(); i++)
-                {
-                    Value *V = I.getOperand(i);
-                    if (oldToNew.count(V))
-                    {
-                        I.setOperand(i, oldToNew[V]);
-                    }
-                }
-            }
-        }
     }
 
     // Handle branch logic of migrated blocks (redirect to exit)
@@ -505,6 +792,43 @@ Function *createFunctionB_v1(Module *M, BasicBlock *moved_bb, StructType *struct
     return funcB;
 }
 
+// Increment the transition counter at the end of the block
+void countTransition(BasicBlock *BB)
+{
+    Module *M = BB->getModule();
+    Type *Int64Ty = Type::getInt64Ty(M->getContext());
+    Constant *counter = M->getOrInsertGlobal("func_split_transitions", Int64Ty);
+    IRBuilder<> Builder(BB);
+    Value *count = Builder.CreateLoad(Int64Ty, counter);
+    Builder.CreateStore(Builder.CreateAdd(count, ConstantInt::get(Int64Ty, 1)), counter);
+}
+
+// First source location in a block, nullptr when it has none
+DILocation *firstLocation(BasicBlock *BB)
+{
+    for (Instruction &I : *BB)
+    {
+        if (DILocation *loc = I.getDebugLoc().get())
+            return loc;
+    }
+    return nullptr;
+}
+
+// Location of the transitions into the region: the first location of the first entry that has one,
+// or the scope line of function a
+DILocation *regionLocation(Function *funcA, const RegionAnalysisResult &result)
+{
+    DISubprogram *SP = funcA->getSubprogram();
+    if (!SP)
+        return nullptr;
+    for (BasicBlock *entryBB : result.entries)
+    {
+        if (DILocation *loc = firstLocation(entryBB))
+            return loc;
+    }
+    return DILocation::get(funcA->getContext(), SP->getScopeLine(), 0, SP);
+}
+
 // Modify the original function a to create proxy logic
 void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *funcB, StructType *structTy, RegionAnalysisResult &result)
 {
@@ -520,15 +844,50 @@ void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *func
     // Get 32-bit integer type
     Type *Int32Ty_funcA = Type::getInt32Ty(Context);
     // Create alloca instruction, allocate memory space for a 32-bit integer type, named myInt
-    Value *flagPtr = Builder.CreateAlloca(Int32Ty_funcA, nullptr, "flag_in");
+    // The entry id is only passed when there are several entries
+    Value *flagPtr = nullptr;
+    if (result.entries.size() > 1)
+    {
+        flagPtr = Builder.CreateAlloca(Int32Ty_funcA, nullptr, "flag_in");
+    }
 
     // Create proxy block
     BasicBlock *proxy = BasicBlock::Create(Context, "proxy", funcA);
+    if (CountTransitions)
+    {
+        countTransition(proxy);
+    }
 
     // Create the switch default label
     // BasicBlock *switch_default_label = BasicBlock::Create(Context, "switch_default", funcA);
     // Builder.SetInsertPoint(switch_default_label);
 
+    Value *structAlloca = nullptr;
+    if (structTy)
+    {
+        // Allocate struct in the entry block
+        Builder.SetInsertPoint(&funcA->getEntryBlock(), funcA->getEntryBlock().begin());
+        structAlloca = Builder.CreateAlloca(structTy);
+
+        // Store the invariant inputs once after their definition instead of on every transition
+        for (unsigned i = 0; i < result.in_values.size(); i++)
+        {
+            if (!result.in_invariant[i])
+                continue;
+            Value *V = result.in_values[i];
+            if (PHINode *PN = dyn_cast<PHINode>(V))
+                Builder.SetInsertPoint(PN->getParent(), PN->getParent()->getFirstInsertionPt());
+            else if (Instruction *I = dyn_cast<Instruction>(V))
+                Builder.SetInsertPoint(I->getNextNode());
+            else
+                Builder.SetInsertPoint(funcA->getEntryBlock().getTerminator());
+            if (Instruction *I = dyn_cast<Instruction>(V))
+                Builder.SetCurrentDebugLocation(I->getDebugLoc());
+            Value *GEP = Builder.CreateStructGEP(structTy, structAlloca, i);
+            Builder.CreateStore(V, GEP);
+        }
+    }
+
     // Create proxy blocks for each entry point
     for (BasicBlock *entryBB : result.entries)
     {
@@ -555,29 +914,38 @@ void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *func
 
         // Set the flag for calling function b
         IRBuilder<> Builder(proxy_flag);
+        DILocation *entry_loc = firstLocation(entryBB);
+        Builder.SetCurrentDebugLocation(entry_loc ? entry_loc : regionLocation(funcA, result));
+
+        if (flagPtr)
+        {
+            Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), result.entry_id_map[entryBB]), flagPtr);
+        }
 
-        Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), result.entry_id_map[entryBB]), flagPtr);
+        // Fill in the inputs used on paths from this entry that may have changed since the last transition
+        if (structTy)
+        {
+            for (int i : result.entry_in_idx[entryBB])
+            {
+                if (result.in_invariant[i])
+                    continue;
+                Value *GEP = Builder.CreateStructGEP(structTy, structAlloca, i);
+                Builder.CreateStore(result.in_values[i], GEP);
+            }
+        }
         Builder.CreateBr(proxy);
     }
 
     Value *retCode = nullptr;
+    Builder.SetCurrentDebugLocation(regionLocation(funcA, result));
     if (structTy)
     {
-        // Allocate struct in proxy block and fill in inputs
-        Builder.SetInsertPoint(&funcA->getEntryBlock(), funcA->getEntryBlock().begin());
-        Value *structAlloca = Builder.CreateAlloca(structTy);
-
         Builder.SetInsertPoint(proxy);
-        for (unsigned i = 0; i < result.in_values.size(); i++)
-        {
-            Value *GEP = Builder.CreateStructGEP(structTy, structAlloca, i);
-            Builder.CreateStore(result.in_values[i], GEP);
-        }
 
         // Call function B and get the return value
         if (result.entries.size() > 1)
         {
-            Value *flag = Builder.CreateLoad(flagPtr);
+            Value *flag = Builder.CreateLoad(Int32Ty_funcA, flagPtr);
             retCode = Builder.CreateCall(funcB, {structAlloca, flag});
         }
         else
@@ -590,7 +958,7 @@ void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *func
         Builder.SetInsertPoint(proxy);
         if (result.entries.size() > 1)
         {
-            Value *flag = Builder.CreateLoad(flagPtr);
+            Value *flag = Builder.CreateLoad(Int32Ty_funcA, flagPtr);
             retCode = Builder.CreateCall(funcB, {flag});
         }
         else
@@ -604,15 +972,8 @@ void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *func
     Builder.SetInsertPoint(proxy);
     if (result.exits.size() != 0)
     {
-        // Create Switch to jump to the corresponding exit
-        SwitchInst *switchInst = Builder.CreateSwitch(
-            retCode,
-            result.exits[0], // Default to the first exit
-            result.exits.size());
-        for (unsigned i = 0; i < result.exits.size(); i++)
-        {
-            switchInst->addCase(ConstantInt::get(Type::getInt32Ty(Context), i), result.exits[i]);
-        }
+        // Jump to the corresponding exit, hottest first
+        createDispatch(Builder, retCode, result.exits, result.exit_freq);
     }
     else
     {
@@ -630,6 +991,296 @@ void modifyFunctionA(Function *funcA, const BasicBlockSet region, Function *func
     funcB->print(outs());
 }
 
+// Replace the uses of input variables in function b with the loaded values
+// The loads of different entries are merged where their paths join, so this must run after the
+// predecessors in function a have been redirected to the proxy blocks
+void rewriteRegionInputs(Function *funcB, RegionAnalysisResult &result)
+{
+    for (unsigned i = 0; i < result.in_values.size(); i++)
+    {
+        Value *V = result.in_values[i];
+        SSAUpdater SSA;
+        SSA.Initialize(V->getType(), V->getName());
+        for (auto &load : result.in_loads[i])
+        {
+            SSA.AddAvailableValue(load.first, load.second);
+        }
+        std::vector<Use *> uses;
+        for (Use &U : V->uses())
+        {
+            Instruction *UI = dyn_cast<Instruction>(U.getUser());
+            if (UI && UI->getFunction() == funcB)
+            {
+                uses.push_back(&U);
+            }
+        }
+        for (Use *U : uses)
+        {
+            SSA.RewriteUse(*U);
+        }
+    }
+}
+
+// Follow GEPs and casts back to the pointer they are based on
+static Value *stripToBase(Value *V)
+{
+    while (true)
+    {
+        if (GEPOperator *GEP = dyn_cast<GEPOperator>(V))
+            V = GEP->getPointerOperand();
+        else if (BitCastOperator *BC = dyn_cast<BitCastOperator>(V))
+            V = BC->getOperand(0);
+        else
+            return V;
+    }
+}
+
+// Whether ptr is only loaded from and stored to, through GEPs and casts
+// Stores of the pointer itself into the struct of the call are allowed for the allocas of function a
+static bool isOnlyAccessed(Value *ptr, Value *structPtr, const std::map<Value *, int> &same)
+{
+    for (User *U : ptr->users())
+    {
+        if (LoadInst *LI = dyn_cast<LoadInst>(U))
+        {
+            if (LI->getPointerOperand() != ptr)
+                return false;
+        }
+        else if (StoreInst *SI = dyn_cast<StoreInst>(U))
+        {
+            if (SI->getValueOperand() == ptr &&
+                (!structPtr || SI->getPointerOperand()->stripInBoundsConstantOffsets() != structPtr))
+                return false;
+        }
+        else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U))
+        {
+            if (!isOnlyAccessed(U, structPtr, same))
+                return false;
+        }
+        else if (!isa<PHINode>(U) || !same.count(U))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Allocas of function a forwarded to function b never escape anywhere else, so the memory
+// accesses through them in function b cannot alias any other access there. Give each of them
+// its own alias scope, so that they can be promoted to registers inside loops of the fragment
+void addForwardedAllocaScopes(Function *funcB, RegionAnalysisResult &result)
+{
+    if (funcB->getNumUses() != 1 || funcB->arg_empty() || result.in_values.empty())
+    {
+        return;
+    }
+    CallBase *call = dyn_cast<CallBase>(funcB->user_back());
+    if (!call)
+    {
+        return;
+    }
+    Value *structPtr = call->getArgOperand(0);
+
+    // Values of function b holding each candidate alloca: the loads from the struct and the PHIs of the rewrite
+    std::map<Value *, int> holder;
+    for (unsigned i = 0; i < result.in_values.size(); i++)
+    {
+        AllocaInst *AI = dyn_cast<AllocaInst>(result.in_values[i]);
+        if (!AI || AI->getFunction() != call->getFunction())
+            continue;
+        for (auto &load : result.in_loads[i])
+            holder[load.second] = i;
+    }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (BasicBlock &BB : *funcB)
+        {
+            for (PHINode &PN : BB.phis())
+            {
+                if (holder.count(&PN))
+                    continue;
+                int idx = -1;
+                for (Value *In : PN.incoming_values())
+                {
+                    auto it = holder.find(In);
+                    if (it == holder.end() || (idx != -1 && it->second != idx))
+                    {
+                        idx = -2;
+                        break;
+                    }
+                    idx = it->second;
+                }
+                if (idx >= 0)
+                {
+                    holder[&PN] = idx;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::set<int> escaped;
+    for (auto &H : holder)
+    {
+        if (!isOnlyAccessed(H.first, nullptr, holder) ||
+            !isOnlyAccessed(result.in_values[H.second], structPtr, holder))
+            escaped.insert(H.second);
+    }
+    MDBuilder MDB(funcB->getContext());
+    MDNode *domain = MDB.createAnonymousAliasScopeDomain(funcB->getName());
+    std::set<int> held;
+    for (auto &H : holder)
+        held.insert(H.second);
+    // Created in the order of the inputs, not of the holder addresses
+    std::map<int, MDNode *> scopes;
+    for (int i : held)
+    {
+        if (!escaped.count(i))
+            scopes[i] = MDB.createAnonymousAliasScope(domain, result.in_values[i]->getName());
+    }
+    if (scopes.empty())
+    {
+        return;
+    }
+
+    auto scopeList = [&](int except)
+    {
+        std::vector<Metadata *> list;
+        for (auto &S : scopes)
+            if (S.first != except)
+                list.push_back(S.second);
+        return MDNode::get(funcB->getContext(), list);
+    };
+    for (BasicBlock &BB : *funcB)
+    {
+        for (Instruction &I : BB)
+        {
+            if (!I.mayReadOrWriteMemory())
+                continue;
+            int idx = -1;
+            bool unknown = false;
+            for (Value *Op : I.operands())
+            {
+                if (!Op->getType()->isPointerTy())
+                    continue;
+                auto it = holder.find(stripToBase(Op));
+                if (it == holder.end())
+                    continue;
+                // A candidate stored as a value, or two different ones, gets no scope
+                bool isPtr = (isa<LoadInst>(I) && cast<LoadInst>(I).getPointerOperand() == Op) ||
+                             (isa<StoreInst>(I) && cast<StoreInst>(I).getPointerOperand() == Op);
+                if (!isPtr || !scopes.count(it->second) || (idx != -1 && idx != it->second))
+                    unknown = true;
+                idx = it->second;
+            }
+            if (unknown)
+                continue;
+            if (idx >= 0)
+            {
+                I.setMetadata(LLVMContext::MD_alias_scope,
+                              MDNode::concatenate(I.getMetadata(LLVMContext::MD_alias_scope),
+                                                  MDNode::get(funcB->getContext(), {scopes[idx]})));
+            }
+            if (scopes.size() > 1 || idx < 0)
+            {
+                I.setMetadata(LLVMContext::MD_noalias,
+                              MDNode::concatenate(I.getMetadata(LLVMContext::MD_noalias), scopeList(idx)));
+            }
+        }
+    }
+}
+
+// Give function b its own subprogram and keep the moved code in the scopes of function a, as if
+// function a had been inlined into function b at the location of the region. Profilers and debuggers
+// then show the source lines of function a under a frame of function b
+void addFragmentDebugInfo(Function *funcA, Function *funcB, RegionAnalysisResult &result)
+{
+    DISubprogram *SP = funcA->getSubprogram();
+    if (!SP)
+        return;
+    LLVMContext &Context = funcA->getContext();
+
+    DIBuilder DIB(*funcA->getParent(), false, SP->getUnit());
+    DISubprogram::DISPFlags flags = DISubprogram::SPFlagDefinition | DISubprogram::SPFlagLocalToUnit;
+    if (SP->isOptimized())
+        flags |= DISubprogram::SPFlagOptimized;
+    DISubprogram *fragmentSP = DIB.createFunction(
+        SP->getUnit(), funcB->getName(), funcB->getName(), SP->getFile(), SP->getLine(),
+        DIB.createSubroutineType(DIB.getOrCreateTypeArray(None)), SP->getScopeLine(), DINode::FlagArtificial, flags);
+    funcB->setSubprogram(fragmentSP);
+    DIB.finalizeSubprogram(fragmentSP);
+
+    // The moved code is "inlined" at the line of function a where the region is entered
+    DILocation *root = regionLocation(funcA, result);
+    while (root->getInlinedAt())
+        root = root->getInlinedAt();
+    DILocation *callSite = DILocation::getDistinct(Context, root->getLine(), root->getColumn(), fragmentSP);
+
+    // Same as InlineFunction: the innermost scope is kept and callSite ends the inlined-at chain
+    DenseMap<const MDNode *, MDNode *> cache;
+    auto inlined = [&](DILocation *loc)
+    {
+        DILocation *inlinedAt = DebugLoc::appendInlinedAt(loc, callSite, Context, cache);
+        return DILocation::get(Context, loc->getLine(), loc->getColumn(), loc->getScope(), inlinedAt);
+    };
+    for (Instruction &I : instructions(funcB))
+    {
+        if (DILocation *loc = I.getDebugLoc().get())
+            I.setDebugLoc(inlined(loc));
+        updateLoopMetadataDebugLocations(I, [&](Metadata *MD) -> Metadata *
+                                         {
+                                             if (DILocation *loc = dyn_cast_or_null<DILocation>(MD))
+                                                 return inlined(loc);
+                                             return MD; });
+    }
+
+    // Blocks created by the split take the location of the moved code next to them: the exit stores
+    // that of the branch they come from, the input loads that of the entry they lead to
+    std::map<BasicBlock *, DebugLoc> block_loc;
+    for (BasicBlock &BB : *funcB)
+    {
+        BasicBlock *pred = BB.getSinglePredecessor();
+        BasicBlock *succ = BB.getSingleSuccessor();
+        if (pred && pred->getTerminator()->getDebugLoc())
+            block_loc[&BB] = pred->getTerminator()->getDebugLoc();
+        else if (succ && firstLocation(succ))
+            block_loc[&BB] = firstLocation(succ);
+        else
+            block_loc[&BB] = callSite;
+    }
+    for (BasicBlock &BB : *funcB)
+    {
+        for (Instruction &I : BB)
+        {
+            if (!I.getDebugLoc() && !isa<PHINode>(I))
+                I.setDebugLoc(block_loc[&BB]);
+        }
+    }
+
+    // Debug intrinsics referring to values left in the other function show the variable as optimized out
+    for (Function *F : {funcA, funcB})
+    {
+        for (Instruction &I : instructions(F))
+        {
+            DbgVariableIntrinsic *DVI = dyn_cast<DbgVariableIntrinsic>(&I);
+            if (!DVI)
+                continue;
+            for (Value *V : DVI->location_ops())
+            {
+                Instruction *def = dyn_cast<Instruction>(V);
+                Argument *arg = dyn_cast<Argument>(V);
+                if ((def && def->getFunction() != F) || (arg && arg->getParent() != F))
+                {
+                    DVI->setUndef();
+                    break;
+                }
+            }
+        }
+    }
+}
+
 void modifyFunctionA_v1(Function *funcA, BasicBlock *moved_bb, Function *funcB, StructType *structTy, BlockData &data)
 {
     LLVMContext &Context = funcA->getContext();
@@ -725,10 +1376,12 @@ bool hasInlineAssembly(llvm::Function &F)
 
 namespace llvm
 {
-    void fixStack(Function &F);
+    std::vector<AllocaInst *> fixStack(Function &F);
 }
-void llvm::fixStack(Function &F)
+// Returns the allocas it creates, so a rejected split can promote them back
+std::vector<AllocaInst *> llvm::fixStack(Function &F)
 {
+    std::vector<AllocaInst *> allocas;
     std::vector<PHINode *> origPHI;
     std::vector<Instruction *> origReg;
     BasicBlock &entryBB = F.getEntryBlock();
@@ -748,12 +1401,55 @@ void llvm::fixStack(Function &F)
     }
     for (PHINode *PN : origPHI)
     {
-        DemotePHIToStack(PN, entryBB.getTerminator());
+        // An unused PHI is erased without a stack slot
+        if (AllocaInst *AI = DemotePHIToStack(PN, entryBB.getTerminator()))
+            allocas.push_back(AI);
     }
     for (Instruction *I : origReg)
     {
-        DemoteRegToStack(*I, entryBB.getTerminator());
+        // The second parameter asks for volatile reloads, which nothing after the split could optimize
+        // The allocas go to the start of the entry block, before the stores of the values defined there
+        allocas.push_back(DemoteRegToStack(*I, false));
+    }
+    return allocas;
+}
+
+// Bytes of the static allocas, the part of the stack frame the split changes
+uint64_t frameSize(Function &F)
+{
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    uint64_t size = 0;
+    for (Instruction &I : F.getEntryBlock())
+    {
+        AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+        if (!AI || !AI->isStaticAlloca())
+            continue;
+        Optional<TypeSize> bytes = AI->getAllocationSizeInBits(DL);
+        if (bytes)
+            size = alignTo(size, AI->getAlign()) + bytes->getFixedSize() / 8;
+    }
+    return size;
+}
+
+// Combined frame after the split of the region analyzed in result: function a gets the struct and the
+// flag_in slot, function b the flag_out slot below the frame of a
+uint64_t predictFrameSize(Function &F, const RegionAnalysisResult &result)
+{
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    uint64_t size = frameSize(F);
+    if (!result.in_values.empty() || !result.out_values.empty())
+    {
+        std::vector<Type *> types;
+        for (Value *V : result.in_values)
+            types.push_back(V->getType());
+        for (Value *V : result.out_values)
+            types.push_back(V->getType());
+        StructType *structTy = StructType::get(F.getContext(), types);
+        size = alignTo(size, DL.getPrefTypeAlign(structTy)) + DL.getTypeAllocSize(structTy);
     }
+    if (result.entries.size() > 1)
+        size = alignTo(size, 4) + 4;
+    return size + CallFrameOverhead + 4;
 }
 
 std::string removeFileExtension(const std::string &filename)
@@ -766,8 +1462,101 @@ std::string removeFileExtension(const std::string &filename)
     return filename;
 }
 
+// Data passed from function a to function b by a candidate region, from analyzeRegion
+struct RegionCost
+{
+    unsigned live_ins = 0;
+    uint64_t bytes = 0; // Size of the struct holding the live-ins
+    unsigned entries = 0;
+    unsigned exits = 0;
+
+    bool operator<(const RegionCost &other) const
+    {
+        return std::make_tuple(bytes, live_ins, entries + exits) <
+               std::make_tuple(other.bytes, other.live_ins, other.entries + other.exits);
+    }
+};
+
+RegionCost evaluateRegion(const BasicBlockSet &region, const DataLayout &DL)
+{
+    RegionAnalysisResult result = analyzeRegion(region, false);
+    RegionCost cost;
+    cost.live_ins = result.in_values.size();
+    cost.entries = result.entries.size();
+    cost.exits = result.exits.size();
+    if (!result.in_values.empty())
+    {
+        std::vector<Type *> types;
+        for (Value *V : result.in_values)
+            types.push_back(V->getType());
+        cost.bytes = DL.getTypeAllocSize(StructType::get(result.in_values[0]->getContext(), types));
+    }
+    return cost;
+}
+
+// Try every contiguous run of blocks whose size is within fraction +/- balance of the function and
+// keep the one passing the least data, ties go to fewer entries and exits, then to the size closest to fraction
+// Large functions try at most 32 sizes and 64 start blocks, spread evenly
+void createMinTransferRegion(Function *func_ptr, BasicBlockSet *region_ptr, double fraction, double balance)
+{
+    std::vector<BasicBlock *> blocks;
+    for (BasicBlock &bb : *func_ptr)
+    {
+        blocks.push_back(&bb);
+    }
+    int n = blocks.size();
+    int target = n * fraction;
+    int min_size = std::max(1, (int)(n * (fraction - balance)));
+    int max_size = std::max(min_size, (int)(n * (fraction + balance)));
+    const DataLayout &DL = func_ptr->getParent()->getDataLayout();
+
+    bool found = false;
+    RegionCost best;
+    int best_begin = 0, best_size = 0;
+    int size_step = std::max(1, (max_size - min_size + 1) / 32);
+    int begin_step = std::max(1, n / 64);
+    // The entry block stays in function a
+    for (int size = min_size; size <= max_size; size += size_step)
+    {
+        for (int begin = 1; begin + size <= n; begin += begin_step)
+        {
+            BasicBlockSet region;
+            for (int i = begin; i < begin + size; i++)
+            {
+                // Like MEAN, the returning block stays in function a
+                if (!isa<ReturnInst>(blocks[i]->getTerminator()))
+                    region.insert(blocks[i]);
+            }
+            if (region.empty())
+                continue;
+            RegionCost cost = evaluateRegion(region, DL);
+            if (cost.entries == 0)
+                continue;
+            if (!found || cost < best || (!(best < cost) && std::abs(size - target) < std::abs(best_size - target)))
+            {
+                found = true;
+                best = cost;
+                best_begin = begin;
+                best_size = size;
+            }
+        }
+    }
+    if (!found)
+        return;
+
+    for (int i = best_begin; i < best_begin + best_size; i++)
+    {
+        if (!isa<ReturnInst>(blocks[i]->getTerminator()))
+            region_ptr->insert(blocks[i]);
+    }
+    errs() << "Cut " << func_ptr->getName() << " at blocks " << best_begin << "-" << best_begin + best_size - 1 << " of " << n
+           << ": " << best.live_ins << " live-ins, " << best.bytes << " bytes, "
+           << best.entries << " entries, " << best.exits << " exits\n";
+}
+
 // Create a region by strategy
-int create_region(Function *func_ptr, Stratery stratery, BasicBlockSet *region_ptr)
+// fraction is the share of the basic blocks moved to function b, balance the tolerance of min-transfer
+int create_region(Function *func_ptr, Stratery stratery, BasicBlockSet *region_ptr, double fraction, double balance)
 {
     std::vector<BasicBlock *> vec_bb_temp;
     region_global.clear();
@@ -779,7 +1568,7 @@ int create_region(Function *func_ptr, Stratery stratery, BasicBlockSet *region_p
         {
             vec_bb_temp.push_back(&bb);
         }
-        for (int i = vec_bb_temp.size() / 2; i < vec_bb_temp.size() - 1; i++)
+        for (int i = vec_bb_temp.size() * (1 - fraction); i < vec_bb_temp.size() - 1; i++)
         {
             if (!isa<ReturnInst>(vec_bb_temp[i]->getTerminator()))
             {
@@ -793,20 +1582,58 @@ int create_region(Function *func_ptr, Stratery stratery, BasicBlockSet *region_p
         break;
     case LOOP:
         break;
+    case MIN_TRANSFER:
+        createMinTransferRegion(func_ptr, region_ptr, fraction, balance);
+        break;
     }
 
     return 0;
 }
 
-int func_split_by_region(Function *func_ptr, BasicBlockSet region)
+// max_live_ins limits the inputs of function b and frame_limit the combined stack frame, 0 for no limit
+// Returns function b, or nullptr when the region is skipped; over_budget tells whether it exceeded frame_limit
+Function *func_split_by_region(Function *func_ptr, BasicBlockSet region, unsigned max_live_ins, uint64_t frame_limit, bool &over_budget)
 {
+    over_budget = false;
     if (region.empty())
     {
-        return 1;
+        return nullptr;
     }
-    LLVMContext Context;
     // Analyze the region
-    RegionAnalysisResult result = analyzeRegion(region);
+    RegionAnalysisResult result;
+    {
+        NamedRegionTimer T("analyzeRegion", "analyzeRegion", PhaseGroup, PhaseGroupDesc, TimePhases);
+        result = analyzeRegion(region, true);
+    }
+    if (max_live_ins && result.in_values.size() > max_live_ins)
+    {
+        errs() << "Skip " << func_ptr->getName() << ": " << result.in_values.size() << " live-ins exceed " << max_live_ins << "\n";
+        return nullptr;
+    }
+    if (frame_limit)
+    {
+        uint64_t frame = predictFrameSize(*func_ptr, result);
+        if (frame > frame_limit)
+        {
+            errs() << "Frame of " << func_ptr->getName() << " would grow to " << frame << " bytes, over the limit of " << frame_limit << "\n";
+            over_budget = true;
+            return nullptr;
+        }
+    }
+
+    {
+        NamedRegionTimer T("transitionAnalysis", "transitionAnalysis", PhaseGroup, PhaseGroupDesc, TimePhases);
+
+        // Find the inputs that stay unchanged across repeated transitions
+        DominatorTree DT(*func_ptr);
+        LoopInfo LI(DT);
+        markInvariantInputs(LI, result);
+
+        // Estimate the transition frequencies to order the entry and exit dispatch
+        BranchProbabilityInfo BPI(*func_ptr, LI);
+        BlockFrequencyInfo BFI(*func_ptr, BPI, LI);
+        estimateTransitionFrequency(region, BFI, BPI, result);
+    }
 
     StructType *structTy = nullptr;
     if (result.in_values.empty())
@@ -833,85 +1660,336 @@ int func_split_by_region(Function *func_ptr, BasicBlockSet region)
     }
 
     // Create function B and migrate basic blocks
-    Function *funcB = createFunctionB(func_ptr, region, structTy, flag_in, result);
+    Function *funcB = nullptr;
+    {
+        NamedRegionTimer T("createFunctionB", "createFunctionB", PhaseGroup, PhaseGroupDesc, TimePhases);
+        funcB = createFunctionB(func_ptr, region, structTy, flag_in, result);
+    }
 
     // Modify function A
-    modifyFunctionA(func_ptr, region, funcB, structTy, result);
+    {
+        NamedRegionTimer T("modifyFunctionA", "modifyFunctionA", PhaseGroup, PhaseGroupDesc, TimePhases);
+        modifyFunctionA(func_ptr, region, funcB, structTy, result);
+    }
+    {
+        NamedRegionTimer T("rewriteRegionInputs", "rewriteRegionInputs", PhaseGroup, PhaseGroupDesc, TimePhases);
+        rewriteRegionInputs(funcB, result);
+        if (AbiAttributes)
+        {
+            addForwardedAllocaScopes(funcB, result);
+        }
+        addFragmentDebugInfo(func_ptr, funcB, result);
+    }
     func_ptr->print(outs());
     funcB->print(outs());
 
     // Verify and output
-    verifyFunction(*func_ptr);
-    verifyFunction(*funcB);
+    {
+        NamedRegionTimer T("verification", "verification", PhaseGroup, PhaseGroupDesc, TimePhases);
+        verifyFunction(*func_ptr);
+        verifyFunction(*funcB);
+    }
 
-    return 0;
+    return funcB;
 }
 
 #if 1
-// Define command-line parameters
-static cl::opt<std::string> MyParameter(
-    "my-parameter",                            // Parameter name
-    cl::desc("A custom parameter for MyPass"), // Parameter description
-    cl::value_desc("string"),                  // Parameter value type
-    cl::init("default-value")                  // Default value
-);
+// Choose the split of each function from a policy file, see README.md for the format
+static cl::opt<std::string> PolicyFile(
+    "func-split-policy",
+    cl::desc("Policy file choosing strategy, fraction, max-live-ins and exclusion per function"),
+    cl::value_desc("filename"),
+    cl::init(""));
+
+// The split settings of one function
+struct SplitPolicy
+{
+    Stratery strategy;
+    double fraction;       // Share of the basic blocks moved to the split function
+    unsigned max_live_ins; // Functions with more inputs are not split, 0 for no limit
+    unsigned frame_budget; // Largest growth of the combined stack frame in bytes, 0 for no limit
+    double balance;        // Size tolerance of the min-transfer region
+    bool exclude;          // Leave the function untouched
+};
 
-namespace
+// One section of the policy file, the keys it does not set keep the value of earlier sections
+struct PolicyRule
 {
-    // Define Pass
-    struct MyPass : public FunctionPass
+    bool module; // [module PATTERN] sets the defaults of the matching modules
+    std::string pattern;
+    Optional<GlobPattern> glob;
+    std::shared_ptr<Regex> regex; // Patterns starting with re: are regular expressions
+    Optional<Stratery> strategy;
+    Optional<double> fraction;
+    Optional<unsigned> max_live_ins;
+    Optional<unsigned> frame_budget;
+    Optional<double> balance;
+    Optional<bool> exclude;
+
+    bool matches(StringRef name) const
     {
-        static char ID; // Pass identifier
-        MyPass() : FunctionPass(ID) {}
+        return regex ? regex->match(name) : glob->match(name);
+    }
+};
 
-        // Override runOnFunction method to define Pass logic
-        bool runOnFunction(Function &F) override
+static std::vector<PolicyRule> PolicyRules;
+
+static void policyError(int line, const Twine &msg)
+{
+    report_fatal_error("func_split: " + PolicyFile + ":" + Twine(line) + ": " + msg, false);
+}
+
+static PolicyRule createRule(bool module, StringRef pattern, int line)
+{
+    PolicyRule rule;
+    rule.module = module;
+    rule.pattern = pattern.str();
+    if (pattern.consume_front("re:"))
+    {
+        rule.regex = std::make_shared<Regex>(pattern);
+        std::string error;
+        if (!rule.regex->isValid(error))
+            policyError(line, "invalid regex '" + pattern + "': " + error);
+    }
+    else
+    {
+        Expected<GlobPattern> glob = GlobPattern::create(pattern);
+        if (!glob)
+            policyError(line, "invalid glob '" + pattern + "': " + toString(glob.takeError()));
+        rule.glob = std::move(*glob);
+    }
+    return rule;
+}
+
+// Lines before the first section are defaults of every module:
+//   strategy = mean
+//   [module PATTERN]
+//   fraction = 0.3
+//   [PATTERN]
+//   exclude = true
+static void loadPolicy(StringRef path)
+{
+    PolicyRules.clear();
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+        report_fatal_error("func_split: cannot read " + path + ": " + buffer.getError().message(), false);
+
+    PolicyRules.push_back(createRule(true, "*", 0));
+    SmallVector<StringRef, 64> lines;
+    (*buffer)->getBuffer().split(lines, '\n');
+    for (unsigned i = 0; i < lines.size(); i++)
+    {
+        int line = i + 1;
+        StringRef text = lines[i].split('#').first.trim();
+        if (text.empty())
+            continue;
+
+        if (text.consume_front("["))
         {
-            outs() << F.getName().str() << "\n";
-            StringRef str_func_name = F.getName();
+            if (!text.consume_back("]"))
+                policyError(line, "missing ]");
+            text = text.trim();
+            bool module = text.consume_front("module ");
+            PolicyRules.push_back(createRule(module, text.trim(), line));
+            continue;
+        }
 
-            // bool a = str_func_name.contains("_splitabc");
-            // Check if the function has already been processed
-            if (F.getName().contains("_splitFlag"))
-            {
-                return false; // If already processed, return false directly
-            }
+        std::pair<StringRef, StringRef> kv = text.split('=');
+        StringRef key = kv.first.trim(), value = kv.second.trim();
+        PolicyRule &rule = PolicyRules.back();
+        if (key == "strategy")
+        {
+            if (value == "mean")
+                rule.strategy = MEAN;
+            else if (value == "domtree")
+                rule.strategy = DOMTREE;
+            else if (value == "loop")
+                rule.strategy = LOOP;
+            else if (value == "min-transfer")
+                rule.strategy = MIN_TRANSFER;
+            else
+                policyError(line, "unknown strategy '" + value + "'");
+        }
+        else if (key == "fraction")
+        {
+            double fraction;
+            if (value.getAsDouble(fraction) || fraction <= 0 || fraction >= 1)
+                policyError(line, "fraction must be between 0 and 1");
+            rule.fraction = fraction;
+        }
+        else if (key == "max-live-ins")
+        {
+            unsigned max_live_ins;
+            if (value.getAsInteger(10, max_live_ins))
+                policyError(line, "max-live-ins must be a number");
+            rule.max_live_ins = max_live_ins;
+        }
+        else if (key == "frame-budget")
+        {
+            unsigned frame_budget;
+            if (value.getAsInteger(10, frame_budget))
+                policyError(line, "frame-budget must be a number");
+            rule.frame_budget = frame_budget;
+        }
+        else if (key == "balance")
+        {
+            double balance;
+            if (value.getAsDouble(balance) || balance < 0 || balance >= 1)
+                policyError(line, "balance must be between 0 and 1");
+            rule.balance = balance;
+        }
+        else if (key == "exclude")
+        {
+            if (value != "true" && value != "false")
+                policyError(line, "exclude must be true or false");
+            rule.exclude = value == "true";
+        }
+        else
+        {
+            policyError(line, "unknown key '" + key + "'");
+        }
+    }
+}
 
-            // Check if it has inline assembly
-            if (hasInlineAssembly(F))
-            {
-                return false; // If it has inline assembly, return false directly
-            }
+static void applyRule(const PolicyRule &rule, SplitPolicy &policy)
+{
+    if (rule.strategy)
+        policy.strategy = *rule.strategy;
+    if (rule.fraction)
+        policy.fraction = *rule.fraction;
+    if (rule.max_live_ins)
+        policy.max_live_ins = *rule.max_live_ins;
+    if (rule.frame_budget)
+        policy.frame_budget = *rule.frame_budget;
+    if (rule.balance)
+        policy.balance = *rule.balance;
+    if (rule.exclude)
+        policy.exclude = *rule.exclude;
+}
 
-            // 1. Create Pass Manager
-            legacy::FunctionPassManager FPM(F.getParent());
+// Module sections first, then the function sections, each in file order
+static SplitPolicy getPolicy(const Function &F)
+{
+    SplitPolicy policy = {SplitStrategy, 0.5, 0, FrameBudget, SplitBalance, false};
+    StringRef module = F.getParent()->getSourceFileName();
+    for (const PolicyRule &rule : PolicyRules)
+        if (rule.module && rule.matches(module))
+            applyRule(rule, policy);
+    for (const PolicyRule &rule : PolicyRules)
+        if (!rule.module && rule.matches(F.getName()))
+            applyRule(rule, policy);
+    return policy;
+}
 
-            // 2. Add mergereturn Pass
-            FPM.add(createUnifyFunctionExitNodesPass());
+// Split one function by its policy
+static bool splitFunction(Function &F)
+{
+    outs() << F.getName().str() << "\n";
+    StringRef str_func_name = F.getName();
 
-            // 3. Run mergereturn Pass
-            FPM.run(F);
+    // bool a = str_func_name.contains("_splitabc");
+    // Check if the function has already been processed
+    if (F.getName().contains("_splitFlag"))
+    {
+        return false; // If already processed, return false directly
+    }
 
-            // Repair evasion variable and phi node
-            fixStack(F);
-            // Note: repair the phi first and the phi result is used in other block
-            fixStack(F);
+    // Check if it has inline assembly
+    if (hasInlineAssembly(F))
+    {
+        return false; // If it has inline assembly, return false directly
+    }
 
-            errs() << "MyPass is running on function: " << F.getName() << "\n";
-            errs() << "MyParameter value: " << MyParameter << "\n";
+    SplitPolicy policy = getPolicy(F);
+    if (policy.exclude)
+    {
+        errs() << "Excluded by policy: " << F.getName() << "\n";
+        return false;
+    }
 
-            region_global.clear();
-            create_region(&F, MEAN, &region_global);
-            int hold = func_split_by_region(&F, region_global);
+    uint64_t frame_before = frameSize(F);
 
-            if (hold)
-            {
-                return false;
-            }
-            else
+    // 1. Create Pass Manager
+    legacy::FunctionPassManager FPM(F.getParent());
+
+    // 2. Add mergereturn Pass
+    FPM.add(createUnifyFunctionExitNodesPass());
+
+    // 3. Run mergereturn Pass
+    bool changed = FPM.run(F);
+
+    // Repair evasion variable and phi node
+    std::vector<AllocaInst *> demoted;
+    {
+        NamedRegionTimer T("fixStack", "fixStack", PhaseGroup, PhaseGroupDesc, TimePhases);
+        demoted = fixStack(F);
+        // Note: repair the phi first and the phi result is used in other block
+        std::vector<AllocaInst *> second = fixStack(F);
+        demoted.insert(demoted.end(), second.begin(), second.end());
+    }
+
+    errs() << "MyPass is running on function: " << F.getName() << "\n";
+    static const char *StrategyNames[] = {"mean", "domtree", "loop", "min-transfer"};
+    errs() << "Policy: strategy " << StrategyNames[policy.strategy] << ", fraction " << policy.fraction
+           << ", max-live-ins " << policy.max_live_ins << ", frame-budget " << policy.frame_budget
+           << ", balance " << policy.balance << "\n";
+
+    region_global.clear();
+    {
+        NamedRegionTimer T("create_region", "create_region", PhaseGroup, PhaseGroupDesc, TimePhases);
+        create_region(&F, policy.strategy, &region_global, policy.fraction, policy.balance);
+    }
+    uint64_t frame_limit = policy.frame_budget ? frame_before + policy.frame_budget : 0;
+    bool over_budget = false;
+    Function *funcB = func_split_by_region(&F, region_global, policy.max_live_ins, frame_limit, over_budget);
+    if (over_budget && policy.strategy != MIN_TRANSFER)
+    {
+        // Re-plan with the cut passing the least data, which keeps the struct small
+        region_global.clear();
+        create_region(&F, MIN_TRANSFER, &region_global, policy.fraction, policy.balance);
+        funcB = func_split_by_region(&F, region_global, policy.max_live_ins, frame_limit, over_budget);
+    }
+
+    if (!funcB)
+    {
+        // Promote the fixStack slots back to registers, only the merged return of mergereturn stays
+        DominatorTree DT(F);
+        PromoteMemToReg(demoted, DT);
+        if (over_budget)
+        {
+            errs() << "Rejected " << F.getName() << ": frame budget of " << policy.frame_budget << " bytes exceeded\n";
+        }
+        return changed || !demoted.empty();
+    }
+
+    uint64_t frame_after = frameSize(F) + CallFrameOverhead + frameSize(*funcB);
+    errs() << "Frame " << F.getName() << ": " << frame_before << " -> " << frame_after << " bytes ("
+           << (frame_after >= frame_before ? "+" : "-")
+           << (frame_after >= frame_before ? frame_after - frame_before : frame_before - frame_after) << ")\n";
+    return true;
+}
+
+namespace
+{
+    // Define Pass
+    struct MyPass : public FunctionPass
+    {
+        static char ID; // Pass identifier
+        MyPass() : FunctionPass(ID) {}
+
+        bool doInitialization(Module &) override
+        {
+            if (!PolicyFile.empty())
             {
-                return true; // Return false to indicate no modification to the function
+                loadPolicy(PolicyFile);
             }
+            return false;
+        }
+
+        // Override runOnFunction method to define Pass logic
+        bool runOnFunction(Function &F) override
+        {
+            return splitFunction(F);
         }
     };
 }
@@ -921,4 +1999,46 @@ char MyPass::ID = 0; // Initialize Pass identifier
 // Register Pass
 static RegisterPass<MyPass> X("func_split", "func_split pass");
 
+// Add the pass to the standard pipeline at the extension point of -func-split-placement
+// fixStack leaves its demoted values in memory, so when the split runs after the scalar
+// optimizations they are promoted back to registers before the rest of the pipeline
+static void addSplitPass(legacy::PassManagerBase &PM, Placement Place)
+{
+    if (SplitPlacement != Place)
+    {
+        return;
+    }
+    PM.add(new MyPass());
+    if (Place != PLACE_PRE_OPT)
+    {
+        PM.add(createPromoteMemoryToRegisterPass());
+    }
+}
+
+static RegisterStandardPasses RegisterPreOpt(
+    PassManagerBuilder::EP_ModuleOptimizerEarly,
+    [](const PassManagerBuilder &, legacy::PassManagerBase &PM)
+    { addSplitPass(PM, PLACE_PRE_OPT); });
+
+static RegisterStandardPasses RegisterPostInline(
+    PassManagerBuilder::EP_VectorizerStart,
+    [](const PassManagerBuilder &, legacy::PassManagerBase &PM)
+    { addSplitPass(PM, PLACE_POST_INLINE); });
+
+static RegisterStandardPasses RegisterPreCodegen(
+    PassManagerBuilder::EP_OptimizerLast,
+    [](const PassManagerBuilder &, legacy::PassManagerBase &PM)
+    { addSplitPass(PM, PLACE_PRE_CODEGEN); });
+
+// -O0 has a single extension point, every placement runs there without the promotion
+static RegisterStandardPasses RegisterO0(
+    PassManagerBuilder::EP_EnabledOnOptLevel0,
+    [](const PassManagerBuilder &, legacy::PassManagerBase &PM)
+    {
+        if (SplitPlacement != PLACE_NONE)
+        {
+            PM.add(new MyPass());
+        }
+    });
+
 #endif
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+
+import os
+import sys
+import subprocess
+import tempfile
+import argparse
+import logging
+
+from custom_compiler import PASS_PATH
+from bench_compile_time import StressGenerator, opt_command
+
+TEST_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'tests')
+
+# Module, pass options, policy file or None, whether function b is expected
+CASES = [
+    ('dead_phi.ll', [], None, False),
+    ('frame_budget.ll', [], None, True),
+    ('frame_budget.ll', ['-func-split-frame-budget=8'], None, False),
+    ('frame_budget.ll', [], '[*]\nmax-live-ins = 1\n', False),
+    ('stress.ll', [], None, True),
+    ('stress.ll', ['-func-split-frame-budget=64'], None, False),
+]
+
+
+def stress_module(blocks):
+    """A generated stress function with a main printing its result"""
+    ir = StressGenerator(blocks, 2, 0.5, 16, 4).generate()
+    args = ', '.join(f'i64 {i * 7 + 3}' for i in range(16))
+    return ir + f'''
+@fmt = private constant [5 x i8] c"%ld\\0A\\00"
+declare i32 @printf(i8*, ...)
+define i32 @main() {{
+  %p = alloca i64
+  store i64 0, i64* %p
+  %r = call i64 @stress({args}, i64* %p)
+  %f = getelementptr [5 x i8], [5 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i64 %r)
+  ret i32 0
+}}
+'''
+
+
+def run_case(cmd, module, options, policy, expect_split, tmpdir):
+    """Split module and check it still verifies and prints the same under lli"""
+    if policy is not None:
+        policy_path = os.path.join(tmpdir, 'case.policy')
+        with open(policy_path, 'w') as f:
+            f.write(policy)
+        options = options + [f'-func-split-policy={policy_path}']
+    split_path = os.path.join(tmpdir, 'split.ll')
+    result = subprocess.run(cmd + options + [module, '-S', '-o', split_path], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if result.returncode != 0:
+        return f'opt failed with {result.returncode}: {result.stderr[-2000:]}'
+    result = subprocess.run(['opt', '-verify', '-disable-output', split_path], capture_output=True, text=True)
+    if result.returncode != 0:
+        return f'broken module: {result.stderr[-2000:]}'
+    with open(split_path) as f:
+        split = '_splitFlag(' in f.read()
+    if split != expect_split:
+        return 'split' if split else 'not split'
+    expected = subprocess.run(['lli', module], capture_output=True, text=True)
+    actual = subprocess.run(['lli', split_path], capture_output=True, text=True)
+    if (actual.returncode, actual.stdout) != (expected.returncode, expected.stdout):
+        return f'lli printed {actual.stdout!r} ({actual.returncode}), expected {expected.stdout!r} ({expected.returncode})'
+    return None
+
+
+if __name__ == '__main__':
+    logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(levelname)s - %(message)s')
+
+    parser = argparse.ArgumentParser(description='Regression tests of the func_split pass, run with opt and lli.')
+    parser.add_argument('-b', '--blocks', type=int, default=128, help="Basic blocks of the generated stress module")
+    parser.add_argument('--pass-path', type=str, default=PASS_PATH, help="Path of func_split_pass.so")
+    args = parser.parse_args()
+
+    cmd = opt_command(args.pass_path)
+    failed = 0
+    with tempfile.TemporaryDirectory() as tmpdir:
+        stress_path = os.path.join(tmpdir, 'stress.ll')
+        with open(stress_path, 'w') as f:
+            f.write(stress_module(args.blocks))
+
+        for name, options, policy, expect_split in CASES:
+            module = stress_path if name == 'stress.ll' else os.path.join(TEST_DIR, name)
+            label = ' '.join([name] + options + (['policy ' + policy.replace('\n', ' ').strip()] if policy else []))
+            error = run_case(cmd, module, options, policy, expect_split, tmpdir)
+            if error:
+                failed += 1
+                logging.error(f'{label}: {error}')
+            else:
+                logging.info(f'{label}: ok')
+
+    logging.info(f'{len(CASES) - failed} of {len(CASES)} cases passed')
+    sys.exit(1 if failed else 0)
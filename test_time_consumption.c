@@ -9,6 +9,15 @@
 #include <stdarg.h>
 #include <string.h>
 #include <getopt.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <math.h>
+#include <spawn.h>
+#include <sys/mman.h>
 
 const char *type_list[] = {
     "clang_O0",
@@ -43,6 +52,51 @@ char *program_list[][5] = {
 };
 const int program_count = sizeof(program_list) / sizeof(program_list[0]);
 
+// Hardware counters recorded for each program/type pair with -p
+struct counter_def {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+#define CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+const struct counter_def counter_list[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1i_misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1I)},
+    {"itlb_misses", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_ITLB)},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+#define COUNTER_COUNT (sizeof(counter_list) / sizeof(counter_list[0]))
+
+// value, time_enabled, time_running as read with PERF_FORMAT_TOTAL_TIME_*
+struct counter_read {
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+int counter_fd[COUNTER_COUNT];
+int counters = 0;
+
+// Results of one program/type pair of the benchmark matrix
+struct cell_result {
+    double elapsed;
+    double counter[COUNTER_COUNT];
+    int counted[COUNTER_COUNT];
+};
+
+int times = 10000;
+int warmup = 10;
+struct cell_result *cell_results;
+double *latency; // program x type x round, in microseconds
+FILE *result_fp;
+FILE *counter_fp;
+FILE *stats_fp;
+FILE *latency_fp;
+
 int debug = 0;
 
 void logging(const char *level, const char *format, va_list args) {
@@ -71,21 +125,470 @@ void log_debug(const char *format, ...) {
     va_end(args);
 }
 
+static long perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// Open the counters on this process, inherited by every child forked afterwards
+// Falls back to user space only counting when the kernel forbids counting the kernel
+void open_counters(void) {
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_list[c].type;
+        attr.config = counter_list[c].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counter_fd[c] = perf_event_open(&attr, 0, -1, -1, 0);
+        if (counter_fd[c] == -1 && (errno == EACCES || errno == EPERM)) {
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            counter_fd[c] = perf_event_open(&attr, 0, -1, -1, 0);
+            if (counter_fd[c] != -1)
+                log_info("Counter %s: user space only", counter_list[c].name);
+        }
+        if (counter_fd[c] == -1)
+            log_info("Counter %s unavailable: %s", counter_list[c].name, strerror(errno));
+    }
+}
+
+void read_counters(struct counter_read *reads) {
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        memset(&reads[c], 0, sizeof(reads[c]));
+        if (counter_fd[c] != -1 && read(counter_fd[c], &reads[c], sizeof(reads[c])) != sizeof(reads[c]))
+            memset(&reads[c], 0, sizeof(reads[c]));
+    }
+}
+
+void enable_counters(int enable) {
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        if (counter_fd[c] != -1)
+            ioctl(counter_fd[c], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+// Standard streams of the benchmarked programs go to /dev/null
+posix_spawn_file_actions_t spawn_actions;
+
+void init_launcher(void) {
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd == -1) {
+        perror("open failed");
+        exit(EXIT_FAILURE);
+    }
+    posix_spawn_file_actions_init(&spawn_actions);
+    posix_spawn_file_actions_adddup2(&spawn_actions, null_fd, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&spawn_actions, null_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&spawn_actions, null_fd, STDERR_FILENO);
+}
+
+// Start one execution of a program, returns -1 when it cannot be started
+pid_t launch(const char *path, char *const argv[]) {
+    char *envp[1] = {NULL};
+    pid_t pid;
+    int err = posix_spawn(&pid, path, &spawn_actions, NULL, argv, envp);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Run the program of one type for times executions
+void run_cell(int cell) {
+    int p = cell / type_count;
+    int t = cell % type_count;
+    struct cell_result *result = &cell_results[cell];
+    char path[1024];
+    snprintf(path, sizeof(path), "./datasets/coreutils-8.30/%s/%s", type_list[t], program_list[p][0]);
+
+    struct counter_read before[COUNTER_COUNT], after[COUNTER_COUNT];
+    if (counters) {
+        read_counters(before);
+        enable_counters(1);
+    }
+
+    struct timeval test_start, test_end;
+    gettimeofday(&test_start, NULL);
+    for (int i = 0; i < times; i++) {
+        pid_t pid = launch(path, program_list[p]);
+        if (pid < 0) {
+            fprintf(stderr, "%s: %m\n", path);
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    gettimeofday(&test_end, NULL);
+    result->elapsed = (test_end.tv_sec - test_start.tv_sec) +
+                      (test_end.tv_usec - test_start.tv_usec) / 1000000.0;
+
+    if (counters) {
+        enable_counters(0);
+        read_counters(after);
+
+        // Counts of the exited children are folded into our counters, so use the difference
+        // and scale it up when the counters were multiplexed
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            uint64_t value = after[c].value - before[c].value;
+            uint64_t enabled = after[c].enabled - before[c].enabled;
+            uint64_t running = after[c].running - before[c].running;
+            result->counted[c] = counter_fd[c] != -1 && running != 0;
+            result->counter[c] = result->counted[c] ? (double)value * enabled / running : 0;
+        }
+    }
+    log_debug("Finished %s/%s", type_list[t], program_list[p][0]);
+}
+
+// Write the row of a program once its last type has finished
+void write_cell(int cell) {
+    int p = cell / type_count;
+    const char *program = program_list[p][0];
+    if (cell % type_count != type_count - 1)
+        return;
+
+    fprintf(result_fp, "%s,%d", program, times);
+    for (int t = 0; t < type_count; t++)
+        fprintf(result_fp, ",%.6f", cell_results[p * type_count + t].elapsed);
+    fprintf(result_fp, "\n");
+    fflush(result_fp);
+
+    if (counter_fp) {
+        for (int t = 0; t < type_count; t++) {
+            struct cell_result *result = &cell_results[p * type_count + t];
+            fprintf(counter_fp, "%s,%s,%d,%.6f", program, type_list[t], times, result->elapsed);
+            for (size_t c = 0; c < COUNTER_COUNT; c++) {
+                if (result->counted[c])
+                    fprintf(counter_fp, ",%.0f", result->counter[c]);
+                else
+                    fprintf(counter_fp, ",");
+            }
+            fprintf(counter_fp, "\n");
+        }
+        fflush(counter_fp);
+    }
+    log_debug("Written data for %s", program);
+}
+
+static uint64_t monotonic_raw_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// xorshift64*, seeded so the randomized round order can be reproduced
+static uint64_t rng_seed = 88172645463325252ull;
+static uint64_t rng_state;
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static void shuffle(int *list, int count) {
+    for (int i = count - 1; i > 0; i--) {
+        int j = rng_next() % (i + 1);
+        int tmp = list[i];
+        list[i] = list[j];
+        list[j] = tmp;
+    }
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Baseline of a type: clang_O<n> for every type built at -O<n>, -1 for the baselines themselves
+int baseline_of(int t) {
+    const char *level = strstr(type_list[t], "O");
+    if (!level)
+        return -1;
+    char name[32];
+    snprintf(name, sizeof(name), "clang_O%c", level[1]);
+    for (int i = 0; i < type_count; i++) {
+        if (strcmp(type_list[i], name) == 0)
+            return i == t ? -1 : i;
+    }
+    return -1;
+}
+
+// Two-sided Mann-Whitney U test with the normal approximation and tie correction
+// a and b must be sorted
+double mann_whitney_p(const double *a, int n1, const double *b, int n2) {
+    double rank_sum = 0, tie_term = 0;
+    int i = 0, j = 0;
+    while (i < n1 || j < n2) {
+        double v = (j >= n2 || (i < n1 && a[i] <= b[j])) ? a[i] : b[j];
+        int ca = 0, cb = 0;
+        while (i < n1 && a[i] == v) {
+            i++;
+            ca++;
+        }
+        while (j < n2 && b[j] == v) {
+            j++;
+            cb++;
+        }
+        // Tied values share the average of their ranks
+        int before = i - ca + j - cb;
+        double avg_rank = before + (ca + cb + 1) / 2.0;
+        rank_sum += ca * avg_rank;
+        double t = ca + cb;
+        tie_term += t * t * t - t;
+    }
+    double n = n1 + n2;
+    double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mu = n1 * (double)n2 / 2.0;
+    double sigma = sqrt(n1 * (double)n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1))));
+    if (sigma == 0)
+        return 1.0;
+    double z = (u - mu) / sigma;
+    return erfc(fabs(z) / sqrt(2.0));
+}
+
+// Run warmup executions of every type of a program, then rounds in which every type runs once
+// in random order, timing each execution on its own
+void run_stats(int p) {
+    int order[type_count];
+    char path[type_count][1024];
+    double *program_latency = &latency[(size_t)p * type_count * times];
+    for (int t = 0; t < type_count; t++)
+        snprintf(path[t], sizeof(path[t]), "./datasets/coreutils-8.30/%s/%s", type_list[t], program_list[p][0]);
+
+    // Every program gets its own order, independent of which worker runs it
+    rng_state = splitmix64(rng_seed ^ (uint64_t)(p + 1)) | 1;
+
+    for (int r = -warmup; r < times; r++) {
+        for (int t = 0; t < type_count; t++)
+            order[t] = t;
+        shuffle(order, type_count);
+
+        for (int k = 0; k < type_count; k++) {
+            int t = order[k];
+            uint64_t start = monotonic_raw_ns();
+            pid_t pid = launch(path[t], program_list[p]);
+            if (pid < 0) {
+                fprintf(stderr, "%s: %m\n", path[t]);
+                exit(EXIT_FAILURE);
+            }
+            waitpid(pid, NULL, 0);
+            uint64_t elapsed = monotonic_raw_ns() - start;
+            if (r >= 0)
+                program_latency[t * times + r] = elapsed / 1000.0;
+        }
+    }
+    log_debug("Finished %s", program_list[p][0]);
+}
+
+// Write the statistics of every type of a program, compared to its baseline
+void write_stats(int p) {
+    const char *program = program_list[p][0];
+    double *program_latency = &latency[(size_t)p * type_count * times];
+
+    if (latency_fp) {
+        for (int t = 0; t < type_count; t++) {
+            for (int r = 0; r < times; r++)
+                fprintf(latency_fp, "%s,%s,%d,%.0f\n", program, type_list[t], r, program_latency[t * times + r] * 1000.0);
+        }
+        fflush(latency_fp);
+    }
+
+    for (int t = 0; t < type_count; t++)
+        qsort(&program_latency[t * times], times, sizeof(double), compare_double);
+
+    for (int t = 0; t < type_count; t++) {
+        double *sorted = &program_latency[t * times];
+        double sum = 0;
+        for (int r = 0; r < times; r++)
+            sum += sorted[r];
+
+        // 95% confidence interval of the median from the order statistics
+        // The bounds are 1-based ranks, lo is shifted to a 0-based index
+        int lo = (int)floor(times / 2.0 - 1.96 * sqrt(times) / 2.0) - 1;
+        int hi = (int)ceil(times / 2.0 + 1.96 * sqrt(times) / 2.0);
+        lo = lo < 0 ? 0 : lo;
+        hi = hi > times - 1 ? times - 1 : hi;
+
+        double median = sorted[times / 2];
+        fprintf(stats_fp, "%s,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f", program, type_list[t], times,
+                sum / times, median, sorted[(int)(0.99 * (times - 1))], sorted[lo], sorted[hi]);
+
+        int b = baseline_of(t);
+        if (b >= 0) {
+            double *base = &program_latency[b * times];
+            fprintf(stats_fp, ",%s,%.6f,%.6g\n", type_list[b], median / base[times / 2],
+                    mann_whitney_p(sorted, times, base, times));
+        } else {
+            fprintf(stats_fp, ",,,\n");
+        }
+    }
+    fflush(stats_fp);
+    log_debug("Written statistics for %s", program);
+}
+
+void pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Run the units 0..count-1 and call done for each of them in order once its results are ready
+// Without cpus the units run in this process; otherwise one worker per cpu, pinned to it, takes
+// the next unit until none is left, and the results come back through shared memory
+void run_units(int count, void (*run)(int), void (*done)(int), const int *cpus, int ncpus) {
+    if (ncpus == 0) {
+        for (int u = 0; u < count; u++) {
+            run(u);
+            done(u);
+        }
+        return;
+    }
+
+    int *next = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next == MAP_FAILED) {
+        perror("mmap failed");
+        exit(EXIT_FAILURE);
+    }
+    *next = 0;
+
+    // Buffered output must not be written again by the workers
+    fflush(NULL);
+    pid_t workers[ncpus];
+    for (int w = 0; w < ncpus; w++) {
+        workers[w] = fork();
+        if (workers[w] == 0) {
+            pin_cpu(cpus[w]);
+            if (counters)
+                open_counters();
+            int u;
+            while ((u = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED)) < count)
+                run(u);
+            _exit(EXIT_SUCCESS);
+        } else if (workers[w] < 0) {
+            perror("fork failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int failed = 0;
+    for (int w = 0; w < ncpus; w++) {
+        int status;
+        waitpid(workers[w], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "worker on CPU %d failed\n", cpus[w]);
+            failed = 1;
+        }
+    }
+    if (failed)
+        exit(EXIT_FAILURE);
+    for (int u = 0; u < count; u++)
+        done(u);
+    munmap(next, sizeof(int));
+}
+
+// Parse a cpu list like 2,3,6-9 into at most max cpus below max, returns 0 when the list is malformed
+int parse_cpus(const char *list, int *cpus, int max) {
+    int count = 0;
+    const char *s = list;
+    while (1) {
+        char *end;
+        if (*s < '0' || *s > '9')
+            return 0;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            s = end + 1;
+            if (*s < '0' || *s > '9')
+                return 0;
+            last = strtol(s, &end, 10);
+        }
+        if (last < first || last >= max || count + (last - first) >= max)
+            return 0;
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus[count++] = cpu;
+        if (*end == '\0')
+            return count;
+        if (*end != ',')
+            return 0;
+        s = end + 1;
+    }
+}
+
+FILE *open_csv(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror("fopen failed");
+        exit(EXIT_FAILURE);
+    }
+    return fp;
+}
+
+void *shared_alloc(size_t size) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("mmap failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
 int main(int argc, char *argv[]) {
-    int times = 10000;
+    int stats = 0;
+    int cpu = -1;
+    int latencies = 0;
+    int cpus[CPU_SETSIZE];
+    int ncpus = 0;
     int opt;
-    char *envp[1] = {NULL};
-    
-    while ((opt = getopt(argc, argv, "t:d")) != -1) {
+
+    while ((opt = getopt(argc, argv, "t:psw:c:S:lj:d")) != -1) {
         switch (opt) {
             case 't':
                 times = atoi(optarg);
                 break;
+            case 'p':
+                counters = 1;
+                break;
+            case 's':
+                stats = 1;
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'c':
+                cpu = atoi(optarg);
+                break;
+            case 'S':
+                rng_seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'l':
+                latencies = 1;
+                break;
             case 'd':
                 debug = 1;
                 break;
+            case 'j':
+                ncpus = parse_cpus(optarg, cpus, CPU_SETSIZE);
+                if (ncpus > 0)
+                    break;
+                // A malformed list is a usage error, not a sequential run
+                // fall through
             default:
-                fprintf(stderr, "Usage: %s [-t times] [-d]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-t times] [-p] [-s [-w warmup] [-S seed] [-l]] [-c cpu | -j cpu_list] [-d]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
@@ -93,79 +596,61 @@ int main(int argc, char *argv[]) {
     log_info("Start");
     struct timeval start, end;
     gettimeofday(&start, NULL);
+    init_launcher();
 
-    FILE *fp = fopen("output/test_time_consumption_result.csv", "w");
-    if (!fp) {
-        perror("fopen failed");
-        exit(EXIT_FAILURE);
+    // Pin to one CPU, the children inherit the affinity
+    if (cpu >= 0) {
+        pin_cpu(cpu);
+        log_info("Pinned to CPU %d", cpu);
     }
+    if (ncpus > 0)
+        log_info("Running on %d workers", ncpus);
 
-    // Write CSV header
-    fprintf(fp, "program,times");
-    for (int i = 0; i < type_count; i++)
-        fprintf(fp, ",%s", type_list[i]);
-    fprintf(fp, "\n");
-    fflush(fp);
+    if (stats) {
+        if (times < 1)
+            times = 1;
+        stats_fp = open_csv("output/test_time_consumption_stats.csv");
+        fprintf(stats_fp, "program,type,runs,mean_us,median_us,p99_us,median_ci95_low_us,median_ci95_high_us,baseline,median_ratio,p_value\n");
+        if (latencies) {
+            latency_fp = open_csv("output/test_time_consumption_latency.csv");
+            fprintf(latency_fp, "program,type,round,ns\n");
+        }
 
-    for (int p = 0; p < program_count; p++) {
-        const char *program = program_list[p][0];
-        char line[4096] = {0};
-        snprintf(line, sizeof(line), "%s,%d", program, times);
+        latency = shared_alloc(sizeof(double) * program_count * type_count * times);
+        run_units(program_count, run_stats, write_stats, cpus, ncpus);
 
-        for (int t = 0; t < type_count; t++) {
-            const char *type = type_list[t];
-            char path[1024];
-            snprintf(path, sizeof(path), "./datasets/coreutils-8.30/%s/%s", type, program);
-
-            struct timeval test_start, test_end;
-            gettimeofday(&test_start, NULL);
-
-            pid_t ppid = vfork();
-            if (ppid == 0) { // Child process
-                int null_fd = open("/dev/null", O_RDWR);
-                if (null_fd == -1) {
-                    perror("open failed");
-                    exit(EXIT_FAILURE);
-                }
-                dup2(null_fd, STDIN_FILENO);
-                dup2(null_fd, STDOUT_FILENO);
-                dup2(null_fd, STDERR_FILENO);
-                close(null_fd);
-
-                for (int i = 0; i < times; i++) {
-                    pid_t pid = vfork();
-                    if (pid == 0) { // Grandchild process
-                        execve(path, program_list[p], envp);
-                        fprintf(stderr, "%s: %m\n", path);
-                        exit(EXIT_FAILURE);
-                    } else if (pid > 0) {
-                        waitpid(pid, NULL, 0);
-                    } else {
-                        perror("fork failed");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                exit(EXIT_SUCCESS);
-            } else if (ppid > 0) {
-                waitpid(ppid, NULL, 0);
-                gettimeofday(&test_end, NULL);
-                double elapsed = (test_end.tv_sec - test_start.tv_sec) +
-                               (test_end.tv_usec - test_start.tv_usec) / 1000000.0;
-                char temp[64];
-                snprintf(temp, sizeof(temp), ",%.6f", elapsed);
-                strcat(line, temp);
-            } else {
-                perror("fork failed");
-                exit(EXIT_FAILURE);
-            }
+        fclose(stats_fp);
+        if (latency_fp)
+            fclose(latency_fp);
+    } else {
+        result_fp = open_csv("output/test_time_consumption_result.csv");
+
+        // Write CSV header
+        fprintf(result_fp, "program,times");
+        for (int i = 0; i < type_count; i++)
+            fprintf(result_fp, ",%s", type_list[i]);
+        fprintf(result_fp, "\n");
+        fflush(result_fp);
+
+        if (counters) {
+            if (ncpus == 0)
+                open_counters();
+            counter_fp = open_csv("output/test_time_consumption_counters.csv");
+            fprintf(counter_fp, "program,type,times,seconds");
+            for (size_t c = 0; c < COUNTER_COUNT; c++)
+                fprintf(counter_fp, ",%s", counter_list[c].name);
+            fprintf(counter_fp, "\n");
+            fflush(counter_fp);
         }
 
-        fprintf(fp, "%s\n", line);
-        fflush(fp);
-        log_debug("Written data for %s", program);
+        cell_results = shared_alloc(sizeof(struct cell_result) * program_count * type_count);
+        run_units(program_count * type_count, run_cell, write_cell, cpus, ncpus);
+
+        fclose(result_fp);
+        if (counter_fp)
+            fclose(counter_fp);
     }
 
-    fclose(fp);
     gettimeofday(&end, NULL);
     double total_time = (end.tv_sec - start.tv_sec) +
                       (end.tv_usec - start.tv_usec) / 1000000.0;
@@ -0,0 +1,20 @@
+; The mean region of f is empty, so the split is rolled back right after fixStack,
+; which erases the unused %dead without giving it a stack slot
+define i32 @f(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  br label %exit
+exit:
+  %dead = phi i32 [ %y, %entry ]
+  %r = mul i32 %x, 3
+  ret i32 %r
+}
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+define i32 @main() {
+  %r = call i32 @f(i32 5)
+  %f = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %r)
+  ret i32 0
+}
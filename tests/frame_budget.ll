@@ -0,0 +1,50 @@
+; work splits with the default options, a small frame budget or max-live-ins rejects it
+; after fixStack, whose demotion of the unused %dead has to be rolled back with the rest
+define i32 @work(i32 %n, i32* %p) {
+entry:
+  %c0 = icmp sgt i32 %n, 10
+  br i1 %c0, label %big, label %small
+big:
+  %a = mul i32 %n, 3
+  br label %loop
+small:
+  %b = add i32 %n, 7
+  br label %mid
+loop:
+  %i = phi i32 [ 0, %big ], [ %i2, %loop ]
+  %s = phi i32 [ %a, %big ], [ %s2, %loop ]
+  %s2 = add i32 %s, %i
+  %i2 = add i32 %i, 1
+  %lc = icmp slt i32 %i2, %n
+  br i1 %lc, label %loop, label %mid
+mid:
+  %v = phi i32 [ %b, %small ], [ %s2, %loop ]
+  %q = load i32, i32* %p
+  %w = add i32 %v, %q
+  %c1 = icmp sgt i32 %w, 50
+  br i1 %c1, label %hi, label %lo
+hi:
+  %x = sub i32 %w, 50
+  br label %done
+lo:
+  %y = mul i32 %w, 2
+  br label %done
+done:
+  %r = phi i32 [ %x, %hi ], [ %y, %lo ]
+  %dead = phi i32 [ %w, %hi ], [ %y, %lo ]
+  ret i32 %r
+}
+
+@g = global i32 5
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8*, ...)
+define i32 @main() {
+  %r1 = call i32 @work(i32 3, i32* @g)
+  %r2 = call i32 @work(i32 20, i32* @g)
+  %r3 = call i32 @work(i32 12, i32* @g)
+  %f = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0
+  call i32 (i8*, ...) @printf(i8* %f, i32 %r1)
+  call i32 (i8*, ...) @printf(i8* %f, i32 %r2)
+  call i32 (i8*, ...) @printf(i8* %f, i32 %r3)
+  ret i32 0
+}
@@ -0,0 +1,438 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vector_store.h"
+
+// Columns of the merged dataset, the same as merge_vector.py
+struct column_def {
+    const char *name;
+    const char *type;
+    const char *suffix;
+};
+
+const struct column_def column_list[] = {
+    {"O0", "clang_O0", ""},
+    {"O1", "clang_O1", ""},
+    {"O2", "clang_O2", ""},
+    {"O3", "clang_O3", ""},
+    {"O0_split", "clang_O0_split_mean", ""},
+    {"O1_split", "clang_O1_split_mean", ""},
+    {"O2_split", "clang_O2_split_mean", ""},
+    {"O3_split", "clang_O3_split_mean", ""},
+    {"O0_splitFlag", "clang_O0_split_mean", "_splitFlag"},
+    {"O1_splitFlag", "clang_O1_split_mean", "_splitFlag"},
+    {"O2_splitFlag", "clang_O2_split_mean", "_splitFlag"},
+    {"O3_splitFlag", "clang_O3_split_mean", "_splitFlag"},
+};
+#define COLUMN_COUNT (sizeof(column_list) / sizeof(column_list[0]))
+
+const char *bypass_list[] = {
+    "_start",
+    "_dl_relocate_static_pie",
+    "deregister_tm_clones",
+    "register_tm_clones",
+    "__do_global_dtors_aux",
+    "frame_dummy",
+};
+#define BYPASS_COUNT (sizeof(bypass_list) / sizeof(bypass_list[0]))
+
+int debug = 0;
+
+void logging(const char *level, const char *format, va_list args) {
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    char time_buf[20];
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", tm_info);
+
+    fprintf(stderr, "%s - %s - ", time_buf, level);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+}
+
+void log_info(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("INFO", format, args);
+    va_end(args);
+}
+
+void log_debug(const char *format, ...) {
+    if (!debug) return;
+    va_list args;
+    va_start(args, format);
+    logging("DEBUG", format, args);
+    va_end(args);
+}
+
+void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    logging("ERROR", format, args);
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+void *map_input(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+        fail("%s: %m", path);
+    *size = st.st_size;
+    void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fail("mmap %s: %m", path);
+    madvise(map, *size, MADV_SEQUENTIAL);
+    return map;
+}
+
+void *map_output(const char *path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || ftruncate(fd, size) == -1)
+        fail("%s: %m", path);
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        fail("mmap %s: %m", path);
+    return map;
+}
+
+// Sequential reader of the raw export
+struct reader {
+    const unsigned char *pos;
+    const unsigned char *end;
+};
+
+static const void *take(struct reader *r, size_t size) {
+    if ((size_t)(r->end - r->pos) < size)
+        fail("truncated export");
+    const void *p = r->pos;
+    r->pos += size;
+    return p;
+}
+
+static uint32_t take_u32(struct reader *r) {
+    uint32_t value;
+    memcpy(&value, take(r, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static uint32_t next_pow2(uint32_t n) {
+    uint32_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+// Convert the raw export into the store, two linear passes over the export
+void build(const char *raw_path, const char *store_path) {
+    size_t raw_size;
+    const unsigned char *raw = map_input(raw_path, &raw_size);
+    const struct raw_header *raw_header = (const struct raw_header *)raw;
+    if (raw_size < sizeof(*raw_header) || memcmp(raw_header->magic, RAW_MAGIC, 8) != 0)
+        fail("%s: not a vector export", raw_path);
+    uint32_t dim = raw_header->dim;
+
+    // Sizes of every section
+    uint64_t group_count = 0, row_count = 0, string_size = 0, bucket_count = 0;
+    struct reader r = {raw + sizeof(*raw_header), raw + raw_size};
+    while (r.pos < r.end) {
+        for (int i = 0; i < 2; i++) {
+            uint32_t len = take_u32(&r);
+            take(&r, len);
+            string_size += len + 1;
+        }
+        uint32_t count = take_u32(&r);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t len = take_u32(&r);
+            take(&r, len);
+            string_size += len + 1;
+        }
+        take(&r, (size_t)count * dim * sizeof(float));
+        group_count++;
+        row_count += count;
+        bucket_count += count ? next_pow2(count * 2) : 0;
+    }
+    if (string_size > UINT32_MAX)
+        fail("string table too large");
+
+    struct store_header header = {0};
+    memcpy(header.magic, STORE_MAGIC, 8);
+    header.dim = dim;
+    header.group_count = group_count;
+    header.row_count = row_count;
+    header.groups_offset = sizeof(header);
+    header.names_offset = header.groups_offset + group_count * sizeof(struct store_group);
+    header.strings_offset = header.names_offset + row_count * sizeof(uint32_t);
+    header.buckets_offset = ALIGN_UP(header.strings_offset + string_size, 4);
+    header.vectors_offset = ALIGN_UP(header.buckets_offset + bucket_count * sizeof(uint32_t), 64);
+    header.file_size = header.vectors_offset + row_count * dim * sizeof(float);
+
+    unsigned char *store = map_output(store_path, header.file_size);
+    memcpy(store, &header, sizeof(header));
+    struct store_group *groups = (struct store_group *)(store + header.groups_offset);
+    uint32_t *names = (uint32_t *)(store + header.names_offset);
+    char *strings = (char *)(store + header.strings_offset);
+    uint32_t *buckets = (uint32_t *)(store + header.buckets_offset);
+    float *vectors = (float *)(store + header.vectors_offset);
+    memset(buckets, 0xff, bucket_count * sizeof(uint32_t));
+
+    uint32_t string_pos = 0;
+    uint64_t row = 0, bucket = 0;
+    r.pos = raw + sizeof(*raw_header);
+    for (uint64_t g = 0; g < group_count; g++) {
+        struct store_group *group = &groups[g];
+        uint32_t *fields[2] = {&group->binary, &group->type};
+        for (int i = 0; i < 2; i++) {
+            uint32_t len = take_u32(&r);
+            *fields[i] = string_pos;
+            memcpy(strings + string_pos, take(&r, len), len);
+            strings[string_pos + len] = '\0';
+            string_pos += len + 1;
+        }
+        group->row_count = take_u32(&r);
+        group->first_row = row;
+        group->bucket_count = group->row_count ? next_pow2(group->row_count * 2) : 0;
+        group->first_bucket = bucket;
+
+        uint32_t *index = buckets + bucket;
+        uint32_t mask = group->bucket_count - 1;
+        for (uint32_t i = 0; i < group->row_count; i++) {
+            uint32_t len = take_u32(&r);
+            const char *name = strings + string_pos;
+            names[row + i] = string_pos;
+            memcpy(strings + string_pos, take(&r, len), len);
+            strings[string_pos + len] = '\0';
+            string_pos += len + 1;
+
+            // The first row of a name wins, like .iloc[0] of the filtered DataFrame
+            uint32_t b = hash_name(name) & mask;
+            while (index[b] != EMPTY_BUCKET && strcmp(strings + names[row + index[b]], name) != 0)
+                b = (b + 1) & mask;
+            if (index[b] == EMPTY_BUCKET)
+                index[b] = i;
+        }
+        memcpy(vectors + row * dim, take(&r, (size_t)group->row_count * dim * sizeof(float)),
+               (size_t)group->row_count * dim * sizeof(float));
+        log_debug("%s/%s: %u functions", strings + group->type, strings + group->binary, group->row_count);
+        row += group->row_count;
+        bucket += group->bucket_count;
+    }
+
+    munmap(store, header.file_size);
+    munmap((void *)raw, raw_size);
+    log_info("%llu binaries/types, %llu functions of dim %u written to %s", (unsigned long long)group_count,
+             (unsigned long long)row_count, dim, store_path);
+}
+
+// Open addressing index of the groups by binary/type, built once per join
+struct group_index {
+    const struct store_group *groups;
+    const char *strings;
+    uint32_t *buckets; // group numbers, EMPTY_BUCKET marks a free bucket
+    uint32_t mask;
+};
+
+static uint64_t group_hash(const char *binary, const char *type) {
+    return hash_name(binary) ^ (hash_name(type) * 0x9e3779b97f4a7c15ull);
+}
+
+void build_group_index(struct group_index *index, const unsigned char *store) {
+    const struct store_header *header = (const struct store_header *)store;
+    index->groups = (const struct store_group *)(store + header->groups_offset);
+    index->strings = (const char *)(store + header->strings_offset);
+    uint32_t bucket_count = 16;
+    while (bucket_count < header->group_count * 2)
+        bucket_count *= 2;
+    index->mask = bucket_count - 1;
+    index->buckets = malloc(sizeof(uint32_t) * bucket_count);
+    if (!index->buckets)
+        fail("malloc failed");
+    memset(index->buckets, 0xff, sizeof(uint32_t) * bucket_count);
+
+    for (uint32_t g = 0; g < header->group_count; g++) {
+        uint32_t i = group_hash(index->strings + index->groups[g].binary, index->strings + index->groups[g].type) & index->mask;
+        while (index->buckets[i] != EMPTY_BUCKET)
+            i = (i + 1) & index->mask;
+        index->buckets[i] = g;
+    }
+}
+
+const struct store_group *find_group(const struct group_index *index, const char *binary, const char *type) {
+    for (uint32_t i = group_hash(binary, type) & index->mask;; i = (i + 1) & index->mask) {
+        if (index->buckets[i] == EMPTY_BUCKET)
+            return NULL;
+        const struct store_group *group = &index->groups[index->buckets[i]];
+        if (strcmp(index->strings + group->binary, binary) == 0 && strcmp(index->strings + group->type, type) == 0)
+            return group;
+    }
+}
+
+static int is_bypassed(const char *name) {
+    if (name[0] == '\0')
+        return 1;
+    for (size_t i = 0; i < BYPASS_COUNT; i++) {
+        if (strcmp(name, bypass_list[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Merge every function of clang_O0 found in all columns, in one pass over the store
+void join(const char *store_path, const char *merged_path) {
+    size_t store_size;
+    const unsigned char *store = map_input(store_path, &store_size);
+    const struct store_header *header = (const struct store_header *)store;
+    if (store_size < sizeof(*header) || memcmp(header->magic, STORE_MAGIC, 8) != 0 || header->file_size != store_size)
+        fail("%s: not a vector store", store_path);
+    const struct store_group *groups = (const struct store_group *)(store + header->groups_offset);
+    const uint32_t *names = (const uint32_t *)(store + header->names_offset);
+    const char *strings = (const char *)(store + header->strings_offset);
+    const float *vectors = (const float *)(store + header->vectors_offset);
+    uint32_t dim = header->dim;
+    struct group_index index;
+    build_group_index(&index, store);
+
+    // Rows of the store that make up each merged row
+    size_t cap = 1024, count = 0;
+    uint64_t string_size = 0;
+    uint64_t (*rows)[COLUMN_COUNT] = malloc(sizeof(*rows) * cap);
+    if (!rows)
+        fail("malloc failed");
+
+    char name_buf[4096];
+    for (uint32_t g = 0; g < header->group_count; g++) {
+        if (strcmp(strings + groups[g].type, column_list[0].type) != 0)
+            continue;
+        const char *binary = strings + groups[g].binary;
+        const struct store_group *column_group[COLUMN_COUNT];
+        int complete = 1;
+        for (size_t c = 0; c < COLUMN_COUNT; c++) {
+            column_group[c] = find_group(&index, binary, column_list[c].type);
+            if (!column_group[c]) {
+                log_info("%s: no %s vectors", binary, column_list[c].type);
+                complete = 0;
+            }
+        }
+        if (!complete)
+            continue;
+
+        size_t before = count;
+        for (uint32_t i = 0; i < groups[g].row_count; i++) {
+            const char *name = strings + names[groups[g].first_row + i];
+            if (is_bypassed(name))
+                continue;
+            if (count == cap) {
+                cap *= 2;
+                rows = realloc(rows, sizeof(*rows) * cap);
+                if (!rows)
+                    fail("realloc failed");
+            }
+            int found = 1;
+            for (size_t c = 0; c < COLUMN_COUNT && found; c++) {
+                snprintf(name_buf, sizeof(name_buf), "%s%s", name, column_list[c].suffix);
+                int64_t row = store_lookup(store, column_group[c], name_buf);
+                found = row >= 0;
+                rows[count][c] = row;
+            }
+            if (found) {
+                string_size += strlen(name) + 1;
+                count++;
+            }
+        }
+        log_debug("%s: %zu functions", binary, count - before);
+    }
+
+    for (size_t c = 0; c < COLUMN_COUNT; c++)
+        string_size += strlen(column_list[c].name) + 1;
+
+    struct merged_header merged = {0};
+    memcpy(merged.magic, MERGED_MAGIC, 8);
+    merged.dim = dim;
+    merged.column_count = COLUMN_COUNT;
+    merged.row_count = count;
+    merged.columns_offset = sizeof(merged);
+    merged.names_offset = merged.columns_offset + COLUMN_COUNT * sizeof(uint32_t);
+    merged.strings_offset = merged.names_offset + count * sizeof(uint32_t);
+    merged.vectors_offset = ALIGN_UP(merged.strings_offset + string_size, 64);
+    merged.file_size = merged.vectors_offset + COLUMN_COUNT * count * dim * sizeof(float);
+
+    unsigned char *out = map_output(merged_path, merged.file_size);
+    memcpy(out, &merged, sizeof(merged));
+    uint32_t *out_columns = (uint32_t *)(out + merged.columns_offset);
+    uint32_t *out_names = (uint32_t *)(out + merged.names_offset);
+    char *out_strings = (char *)(out + merged.strings_offset);
+    float *out_vectors = (float *)(out + merged.vectors_offset);
+
+    uint32_t string_pos = 0;
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+        out_columns[c] = string_pos;
+        strcpy(out_strings + string_pos, column_list[c].name);
+        string_pos += strlen(column_list[c].name) + 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *name = strings + names[rows[i][0]];
+        out_names[i] = string_pos;
+        strcpy(out_strings + string_pos, name);
+        string_pos += strlen(name) + 1;
+    }
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+        float *column = out_vectors + c * count * dim;
+        for (size_t i = 0; i < count; i++)
+            memcpy(column + i * dim, vectors + rows[i][c] * dim, dim * sizeof(float));
+    }
+
+    free(rows);
+    free(index.buckets);
+    munmap(out, merged.file_size);
+    munmap((void *)store, store_size);
+    log_info("Total: %zu", count);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "d")) != -1) {
+        switch (opt) {
+            case 'd':
+                debug = 1;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    if (argc - optind != 3)
+        goto usage;
+
+    log_info("Start");
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    if (strcmp(argv[optind], "build") == 0)
+        build(argv[optind + 1], argv[optind + 2]);
+    else if (strcmp(argv[optind], "join") == 0)
+        join(argv[optind + 1], argv[optind + 2]);
+    else
+        goto usage;
+
+    gettimeofday(&end, NULL);
+    double total_time = (end.tv_sec - start.tv_sec) +
+                      (end.tv_usec - start.tv_usec) / 1000000.0;
+    log_info("[*] Time Cost: %.6f seconds", total_time);
+    return 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-d] build export.raw store.vst\n"
+                    "       %s [-d] join store.vst merged.vmg\n", argv[0], argv[0]);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,97 @@
+// File formats of the embedding store, shared by vector_store.c and the evaluator
+// All integers are little endian, vectors are float32 and start 64-byte aligned
+#ifndef VECTOR_STORE_H
+#define VECTOR_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Export of the pickles written by vector_store.py:
+//   raw_header, then per binary/type: u32 length + binary name, u32 length + type name, u32 count,
+//   count x (u32 length + funcname), count x dim float32
+#define RAW_MAGIC "FSPVRAW1"
+
+struct raw_header {
+    char magic[8];
+    uint32_t dim;
+    uint32_t reserved;
+};
+
+// Store of every binary/type: store_header, groups, row name offsets, string table, vectors
+// Each group has an open addressing funcname index with bucket_count (a power of two) row numbers,
+// EMPTY_BUCKET marks a free bucket and the first row of a duplicated name is the one indexed
+#define STORE_MAGIC "FSPVST01"
+#define EMPTY_BUCKET UINT32_MAX
+
+struct store_header {
+    char magic[8];
+    uint32_t dim;
+    uint32_t group_count;
+    uint64_t row_count;
+    uint64_t groups_offset;  // store_group[group_count]
+    uint64_t names_offset;   // u32[row_count], offsets into the string table
+    uint64_t strings_offset; // NUL terminated strings
+    uint64_t buckets_offset; // u32 row numbers of all group indexes
+    uint64_t vectors_offset; // float32[row_count][dim]
+    uint64_t file_size;
+};
+
+struct store_group {
+    uint32_t binary;    // string table offset
+    uint32_t type;      // string table offset
+    uint64_t first_row;
+    uint32_t row_count;
+    uint32_t bucket_count;
+    uint64_t first_bucket;
+};
+
+// Result of the join, one row per function present in every column:
+//   merged_header, column names, row funcname offsets, string table, then column after column
+//   of float32[row_count][dim]
+#define MERGED_MAGIC "FSPVMG01"
+
+struct merged_header {
+    char magic[8];
+    uint32_t dim;
+    uint32_t column_count;
+    uint64_t row_count;
+    uint64_t columns_offset; // u32[column_count], offsets into the string table
+    uint64_t names_offset;   // u32[row_count], offsets into the string table
+    uint64_t strings_offset;
+    uint64_t vectors_offset; // column c starts at vectors_offset + c * row_count * dim * 4
+    uint64_t file_size;
+};
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~(uint64_t)((a) - 1))
+
+// FNV-1a
+static inline uint64_t hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Absolute row of name in group, or -1
+static inline int64_t store_lookup(const void *store, const struct store_group *group, const char *name) {
+    const struct store_header *header = store;
+    const unsigned char *base = store;
+    const uint32_t *buckets = (const uint32_t *)(base + header->buckets_offset) + group->first_bucket;
+    const uint32_t *names = (const uint32_t *)(base + header->names_offset);
+    const char *strings = (const char *)(base + header->strings_offset);
+    if (group->bucket_count == 0)
+        return -1;
+
+    uint32_t mask = group->bucket_count - 1;
+    for (uint32_t i = hash_name(name) & mask;; i = (i + 1) & mask) {
+        if (buckets[i] == EMPTY_BUCKET)
+            return -1;
+        uint64_t row = group->first_row + buckets[i];
+        if (strcmp(strings + names[row], name) == 0)
+            return row;
+    }
+}
+
+#endif
@@ -0,0 +1,107 @@
+import os
+import struct
+import argparse
+import logging
+import time
+import numpy as np
+import pandas as pd
+from tqdm import tqdm
+
+path_prefix = 'datasets/coreutils-8.30'
+
+type_list = [
+    'clang_O0',
+    'clang_O1',
+    'clang_O2',
+    'clang_O3',
+    'clang_O0_split_mean',
+    'clang_O1_split_mean',
+    'clang_O2_split_mean',
+    'clang_O3_split_mean',
+]
+
+bin_list = ['mv', 'fold', 'nproc', 'groups', 'shred', 'sha384sum', 'whoami', 'printenv', 'mktemp', 'du', 'uname', 'sha1sum', 'hostid', 'od', 'sum', 'unlink', 'basename', 'chgrp', 'nice', 'pinky', 'kill', 'mkdir', 'rm', 'sha256sum', 'sort', 'false', 'cksum', 'split', 'sleep', 'who', 'test', 'chcon', 'tr', 'logname', 'truncate', 'ln', 'stat', 'df', 'numfmt', 'dd', 'fmt', 'users', 'stty', 'chmod', 'tac', 'md5sum', 'nohup', 'uptime', 'csplit', 'timeout', 'paste', 'echo', 'pr', 'chown', 'env', 'ptx', 'mknod', 'sha224sum', 'nl', 'mkfifo', 'ls', 'shuf', 'true', 'cut', 'unexpand', 'comm', 'head', 'base32', 'dircolors', 'chroot', 'runcon', 'dirname', 'seq', 'printf', 'link', 'tty', 'yes', 'id', 'pwd', 'touch', 'vdir', 'join', 'wc', 'realpath', 'base64', 'b2sum', 'factor', 'dir', 'expand', 'uniq', 'cp', 'stdbuf', 'date', 'cat', 'sync', 'sha512sum', 'tail', 'rmdir', 'tsort', 'readlink', 'expr', 'pathchk', 'tee']
+
+# Layouts of vector_store.h
+RAW_HEADER = struct.Struct('<8sII')
+MERGED_HEADER = struct.Struct('<8sIIQQQQQQ')
+
+
+def pack_str(value):
+    data = value.encode()
+    return struct.pack('<I', len(data)) + data
+
+
+def export(model, output):
+    """Write the pickles of every binary/type of a model in the raw format read by `vector_store build`"""
+    dim = None
+    with open(output, 'wb') as f:
+        f.write(RAW_HEADER.pack(b'FSPVRAW1', 0, 0))
+        for _bin in tqdm(bin_list):
+            for _type in type_list:
+                df = pd.read_pickle(f'{path_prefix}/{_type}/{_bin}_{model}_vector.pkl')
+                vectors = np.stack([np.asarray(v, dtype=np.float32).reshape(-1) for v in df["vector"]]) if len(df) else None
+                if vectors is not None:
+                    if dim is None:
+                        dim = vectors.shape[1]
+                    elif vectors.shape[1] != dim:
+                        raise ValueError(f'{_type}/{_bin}: vector dim {vectors.shape[1]} != {dim}')
+
+                # Missing function names are written empty, the join skips them
+                names = ['' if str(name) == 'nan' else str(name) for name in df["funcname"]]
+                f.write(pack_str(_bin) + pack_str(_type) + struct.pack('<I', len(names)))
+                f.write(b''.join(pack_str(name) for name in names))
+                if vectors is not None:
+                    f.write(np.ascontiguousarray(vectors, dtype='<f4').tobytes())
+        f.seek(0)
+        f.write(RAW_HEADER.pack(b'FSPVRAW1', dim or 0, 0))
+
+
+def read_merged(path):
+    """Memory map the output of `vector_store join`, return (funcnames, {column: float32 matrix})"""
+    data = np.memmap(path, dtype=np.uint8, mode='r')
+    magic, dim, column_count, row_count, columns_offset, names_offset, strings_offset, vectors_offset, file_size = \
+        MERGED_HEADER.unpack_from(data, 0)
+    if magic != b'FSPVMG01' or file_size != len(data):
+        raise ValueError(f'{path}: not a merged vector file')
+
+    strings = bytes(data[strings_offset:vectors_offset])
+
+    def string_list(offset, count):
+        return [strings[o:strings.index(b'\0', o)].decode() for o in np.frombuffer(data, dtype='<u4', count=count, offset=offset)]
+
+    column_names = string_list(columns_offset, column_count)
+    funcnames = string_list(names_offset, row_count)
+    columns = {}
+    for c, name in enumerate(column_names):
+        offset = vectors_offset + c * row_count * dim * 4
+        columns[name] = np.frombuffer(data, dtype='<f4', count=row_count * dim, offset=offset).reshape(row_count, dim)
+    return funcnames, columns
+
+
+def load_merged(path):
+    """The merged file as the DataFrame written by merge_vector.py"""
+    funcnames, columns = read_merged(path)
+    df = pd.DataFrame({"funcname": funcnames})
+    for name, matrix in columns.items():
+        df[name] = list(matrix)
+    return df
+
+
+if __name__ == '__main__':
+    logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(levelname)s - %(message)s')
+
+    logging.info("Start")
+    start = time.time()
+
+    parser = argparse.ArgumentParser(description='Export the vector pickles for the vector_store tool.')
+    parser.add_argument('-m', '--model', type=str, default='jTrans', help="Model of the vector pickles")
+    parser.add_argument('-o', '--output', type=str, default=None, help="Output file, output/<model>_vectors.raw by default")
+    args = parser.parse_args()
+
+    output = args.output or f'output/{args.model}_vectors.raw'
+    export(args.model, output)
+    logging.info(f'Written {output} ({os.path.getsize(output)} bytes)')
+
+    end = time.time()
+    logging.info(f"[*] Time Cost: {end - start} seconds")